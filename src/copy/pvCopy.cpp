@@ -198,6 +198,15 @@ bool PVCopy::updateCopySetBitSet(
     return checkIgnore(copyPVStructure,bitSet);
 }
 
+bool PVCopy::updateCopySetBitSet(
+    PVStructurePtr const  &copyPVStructure,
+    BitSetPtr const  &bitSet,
+    PVStructurePtr const  &pvSnapshot)
+{
+    updateCopySetBitSet(copyPVStructure,headNode,pvSnapshot,bitSet);
+    return checkIgnore(copyPVStructure,bitSet);
+}
+
 bool PVCopy::updateCopyFromBitSet(
     PVStructurePtr const  &copyPVStructure,
     BitSetPtr const  &bitSet)
@@ -390,6 +399,48 @@ void PVCopy::updateCopySetBitSet(
 }
 
 
+// copy and snapshot have the same layout below a leaf node
+static void updateCopySetBitSetFromSnapshot(
+    PVFieldPtr const & pvCopy,
+    PVFieldPtr const & pvSnapshot,
+    BitSetPtr const & bitSet)
+{
+    if(pvCopy->getField()->getType()!=epics::pvData::structure) {
+        if(*pvCopy==*pvSnapshot) return;
+        pvCopy->copy(*pvSnapshot);
+        bitSet->set(pvCopy->getFieldOffset());
+        return;
+    }
+    PVFieldPtrArray const & pvCopyFields =
+        static_pointer_cast<PVStructure>(pvCopy)->getPVFields();
+    PVFieldPtrArray const & pvSnapshotFields =
+        static_pointer_cast<PVStructure>(pvSnapshot)->getPVFields();
+    for(size_t i=0; i<pvCopyFields.size(); ++i) {
+        updateCopySetBitSetFromSnapshot(pvCopyFields[i],pvSnapshotFields[i],bitSet);
+    }
+}
+
+void PVCopy::updateCopySetBitSet(
+    PVFieldPtr const & pvCopy,
+    CopyNodePtr const & node,
+    PVStructurePtr const & pvSnapshot,
+    BitSetPtr const & bitSet)
+{
+    if(!node->isStructure) {
+        size_t offset = node->masterPVField->getFieldOffset();
+        PVFieldPtr pvField = pvSnapshot;
+        if(offset!=0) pvField = pvSnapshot->getSubField(offset);
+        updateCopySetBitSetFromSnapshot(pvCopy,pvField,bitSet);
+        return;
+    }
+    CopyStructureNodePtr structureNode = static_pointer_cast<CopyStructureNode>(node);
+    PVStructurePtr pvCopyStructure = static_pointer_cast<PVStructure>(pvCopy);
+    PVFieldPtrArray const & pvCopyFields = pvCopyStructure->getPVFields();
+    for(size_t i=0; i<pvCopyFields.size(); ++i) {
+        updateCopySetBitSet(pvCopyFields[i],(*structureNode->nodes)[i],pvSnapshot,bitSet);
+    }
+}
+
 void PVCopy::updateCopyFromBitSet(
     PVFieldPtr const & pvCopy,
     CopyNodePtr const & node,
@@ -423,7 +474,8 @@ void PVCopy::updateCopyFromBitSet(
 
 PVCopy::PVCopy(
     PVStructurePtr const &pvMaster)
-: pvMaster(pvMaster)
+: pvMaster(pvMaster),
+  requestHasFilters(false)
 {
 }
 
@@ -642,6 +694,7 @@ void PVCopy::initPlugin(
         if(pvFilters[numfilter]) ++numfilter;
     }
     if(numfilter==0) return;
+    requestHasFilters = true;
     node->pvFilters.resize(numfilter);
     for(size_t i=0; i<numfilter; ++i) node->pvFilters[i] = pvFilters[i];
 }
@@ -10,8 +10,15 @@
  */
 
 #include <epicsGuard.h>
+#include <epicsString.h>
+#include <epicsThreadPool.h>
+#include <epicsAtomic.h>
+#include <epicsThread.h>
+#include <epicsExit.h>
 #include <list>
 #include <map>
+#include <algorithm>
+#include <stdexcept>
 #include <pv/pvData.h>
 #include <pv/pvTimeStamp.h>
 #include <pv/rpcService.h>
@@ -34,30 +41,265 @@ namespace epics { namespace pvDatabase {
 
 #define DEBUG_LEVEL 0
 
-static PVDatabasePtr pvDatabaseMaster;
+namespace {
 
-PVDatabasePtr PVDatabase::getMaster()
+// Work done for each index of [0,number) by runInParallel.
+class IndexTask {
+public:
+    virtual ~IndexTask() {}
+    virtual void run(size_t index) = 0;
+};
+
+// Counts the jobs of one call of runInParallel that have not finished.
+// The pool is shared, so epicsThreadPoolWait can not be used.
+struct RangeDone {
+    RangeDone(size_t number) : number(number) {}
+    epics::pvData::Mutex mutex;
+    size_t number;
+    epicsEvent event;
+};
+
+// The indices [begin,end) handled by one job of the thread pool.
+struct RangeJob {
+    IndexTask * task;
+    RangeDone * done;
+    size_t begin;
+    size_t end;
+    string error;
+};
+
+// Any failure is kept in job->error, to be thrown on the calling thread.
+void runRange(RangeJob * job)
+{
+    try {
+        for(size_t i=job->begin; i<job->end; ++i) job->task->run(i);
+    } catch(std::exception & e) {
+        job->error = e.what();
+        if(job->error.empty()) job->error = "failed";
+    } catch(...) {
+        job->error = "unknown exception";
+    }
+}
+
+void rangeJob(void * arg, epicsJobMode mode)
+{
+    RangeJob * job = static_cast<RangeJob *>(arg);
+    if(mode==epicsJobModeRun) {
+        runRange(job);
+    } else {
+        job->error = "thread pool stopped";
+    }
+    epicsGuard<epics::pvData::Mutex> guard(job->done->mutex);
+    if(--job->done->number==0) job->done->event.signal();
+}
+
+epicsThreadPool * sharedPool = 0;
+epicsThreadOnceId sharedPoolOnce = EPICS_THREAD_ONCE_INIT;
+
+void getSharedPool(void *)
+{
+    epicsThreadPoolConfig config;
+    epicsThreadPoolConfigDefaults(&config);
+    config.workerPriority = epicsThreadPriorityMedium;
+    sharedPool = epicsThreadPoolGetShared(&config);
+}
+
+// Runs task for each index, by numberThreads threads if possible.
+// The calling thread runs the first range, the others are queued
+// on a thread pool that is shared by all calls.
+// Any failure is thrown as std::runtime_error on the calling thread.
+void runInParallel(IndexTask & task,size_t number,size_t numberThreads,string const & who)
+{
+    size_t numberJobs = numberThreads<number ? numberThreads : number;
+    if(numberJobs>1) {
+        epicsThreadOnce(&sharedPoolOnce,getSharedPool,0);
+    }
+    if(numberJobs<=1 || !sharedPool) {
+        RangeJob job;
+        job.task = &task;
+        job.done = 0;
+        job.begin = 0;
+        job.end = number;
+        runRange(&job);
+        if(!job.error.empty()) throw std::runtime_error(who + " " + job.error);
+        return;
+    }
+    RangeDone done(numberJobs-1);
+    vector<RangeJob> jobs(numberJobs);
+    vector<epicsJob *> poolJobs(numberJobs,(epicsJob *)0);
+    size_t perJob = (number + numberJobs - 1)/numberJobs;
+    for(size_t i=0; i<numberJobs; ++i) {
+        jobs[i].task = &task;
+        jobs[i].done = &done;
+        jobs[i].begin = std::min(number,i*perJob);
+        jobs[i].end = std::min(number,(i+1)*perJob);
+    }
+    for(size_t i=1; i<numberJobs; ++i) {
+        poolJobs[i] = epicsJobCreate(sharedPool,rangeJob,&jobs[i]);
+        if(!poolJobs[i] || epicsJobQueue(poolJobs[i])!=0) {
+            rangeJob(&jobs[i],epicsJobModeRun);
+        }
+    }
+    runRange(&jobs[0]);
+    while(true) {
+        {
+            epicsGuard<epics::pvData::Mutex> guard(done.mutex);
+            if(done.number==0) break;
+        }
+        done.event.wait();
+    }
+    for(size_t i=1; i<numberJobs; ++i) {
+        if(poolJobs[i]) epicsJobDestroy(poolJobs[i]);
+    }
+    for(size_t i=0; i<numberJobs; ++i) {
+        if(!jobs[i].error.empty()) {
+            throw std::runtime_error(who + " " + jobs[i].error);
+        }
+    }
+}
+
+class StartTask :
+    public IndexTask
 {
-    static bool firstTime = true;
-    if(firstTime) {
-        firstTime = false;
-        pvDatabaseMaster = PVDatabasePtr(new PVDatabase());
-        PVArrayPlugin::create();
-        PVTimestampPlugin::create();
-        PVDeadbandPlugin::create();
-        DataDistributorPlugin::create();
+public:
+    StartTask(PVRecordPtrArray const & records)
+    : records(records), started(records.size(),0) {}
+    virtual void run(size_t index)
+    {
+        records[index]->start();
+        started[index] = 1;
     }
+    // each index is only written by the thread that runs it
+    vector<char> started;
+private:
+    PVRecordPtrArray const & records;
+};
+
+class CreateTask :
+    public IndexTask
+{
+public:
+    CreateTask(PVRecordCreator & creator,PVRecordPtrArray & records)
+    : creator(creator), records(records) {}
+    virtual void run(size_t index)
+    {
+        records[index] = creator.create(index);
+        if(!records[index]) throw std::runtime_error("record not created");
+    }
+private:
+    PVRecordCreator & creator;
+    PVRecordPtrArray & records;
+};
+
+PVDatabasePtr pvDatabaseMaster;
+epicsThreadOnceId pvDatabaseMasterOnce = EPICS_THREAD_ONCE_INIT;
+
+} // namespace
+
+void PVDatabase::createMaster(void *)
+{
+    pvDatabaseMaster = PVDatabasePtr(new PVDatabase());
+    PVArrayPlugin::create();
+    PVTimestampPlugin::create();
+    PVDeadbandPlugin::create();
+    DataDistributorPlugin::create();
+}
+
+PVDatabasePtr PVDatabase::getMaster()
+{
+    epicsThreadOnce(&pvDatabaseMasterOnce,createMaster,0);
     return pvDatabaseMaster;
 }
 
 PVDatabase::PVDatabase()
+: generation(1),
+  namesGeneration(0),
+  reaperPending(0),
+  reaperStop(false)
 {
     if(DEBUG_LEVEL>0) cout << "PVDatabase::PVDatabase()\n";
 }
 
+// The master is destroyed with the other static objects,
+// when joining a thread can hang, so the reaper is stopped by stopReaperAtExit.
 PVDatabase::~PVDatabase()
 {
     if(DEBUG_LEVEL>0) cout << "PVDatabase::~PVDatabase()\n";
+    stopReaper();
+}
+
+void PVDatabase::stopReaperAtExit(void * arg)
+{
+    static_cast<PVDatabase *>(arg)->stopReaper();
+}
+
+void PVDatabase::stopReaper()
+{
+    {
+        epicsGuard<epics::pvData::Mutex> guard(reaperMutex);
+        if(!reaperThread || reaperStop) return;
+        reaperStop = true;
+    }
+    reaperWakeup.signal();
+    reaperThread->exitWait();
+}
+
+void PVDatabase::reap(PVRecordPtr const & record)
+{
+    {
+        epicsGuard<epics::pvData::Mutex> guard(reaperMutex);
+        if(!reaperStop) {
+            if(!reaperThread) {
+                reaperThread = std::tr1::shared_ptr<epicsThread>(new epicsThread(
+                    *this,
+                    "pvDatabaseReaper",
+                    epicsThreadGetStackSize(epicsThreadStackSmall),
+                    epicsThreadPriorityMedium));
+                reaperThread->start();
+                epicsAtExit(stopReaperAtExit,this);
+            }
+            reaperQueue.push_back(record);
+            ++reaperPending;
+            reaperWakeup.signal();
+            return;
+        }
+    }
+    // the reaper has been stopped at exit
+    record->unlistenClients();
+}
+
+void PVDatabase::run()
+{
+    while(true) {
+        reaperWakeup.wait();
+        while(true) {
+            PVRecordPtr record;
+            {
+                epicsGuard<epics::pvData::Mutex> guard(reaperMutex);
+                if(reaperQueue.empty()) {
+                    if(reaperStop) return;
+                    break;
+                }
+                record = reaperQueue.front();
+                reaperQueue.pop_front();
+            }
+            record->unlistenClients();
+            record.reset();
+            epicsGuard<epics::pvData::Mutex> guard(reaperMutex);
+            if(--reaperPending==0) reaperDone.signal();
+        }
+    }
+}
+
+void PVDatabase::waitForRemovedRecords()
+{
+    while(true) {
+        {
+            epicsGuard<epics::pvData::Mutex> guard(reaperMutex);
+            if(reaperPending==0) return;
+        }
+        reaperDone.wait();
+    }
 }
 
 void PVDatabase::lock() {
@@ -68,11 +310,25 @@ void PVDatabase::unlock() {
     mutex.unlock();
 }
 
+PVDatabase::RecordShard & PVDatabase::getShard(string const & recordName)
+{
+    return shards[epicsStrHash(recordName.c_str(),0) & (numberShards-1)];
+}
+
+bool PVDatabase::isNameUsed(string const & recordName)
+{
+    if(pendingNames.find(recordName)!=pendingNames.end()) return true;
+    RecordShard & shard = getShard(recordName);
+    epicsGuard<epics::pvData::Mutex> guard(shard.mutex);
+    return shard.recordMap.find(recordName)!=shard.recordMap.end();
+}
+
 PVRecordPtr PVDatabase::findRecord(string const& recordName)
 {
-    epicsGuard<epics::pvData::Mutex> guard(mutex);
-    PVRecordMap::iterator iter = recordMap.find(recordName);
-    if(iter!=recordMap.end()) {
+    RecordShard & shard = getShard(recordName);
+    epicsGuard<epics::pvData::Mutex> guard(shard.mutex);
+    PVRecordMap::iterator iter = shard.recordMap.find(recordName);
+    if(iter!=shard.recordMap.end()) {
          return (*iter).second;
     }
     return PVRecordPtr();
@@ -85,23 +341,88 @@ bool PVDatabase::addRecord(PVRecordPtr const & record)
     }
     epicsGuard<epics::pvData::Mutex> guard(mutex);
     string recordName = record->getRecordName();
-    PVRecordMap::iterator iter = recordMap.find(recordName);
-    if(iter!=recordMap.end()) {
-         return false;
-    }
+    if(isNameUsed(recordName)) return false;
+    RecordShard & shard = getShard(recordName);
     record->start();
-    recordMap.insert(PVRecordMap::value_type(recordName,record));
+    {
+        epicsGuard<epics::pvData::Mutex> shardGuard(shard.mutex);
+        shard.recordMap.insert(PVRecordMap::value_type(recordName,record));
+    }
+    epicsAtomicIncrSizeT(&generation);
     return true;
 }
 
-PVRecordWPtr PVDatabase::removeFromMap(PVRecordPtr const & record)
+bool PVDatabase::addRecords(PVRecordPtrArray const & records,size_t numberThreads)
 {
+    vector<string> names(records.size());
+    for(size_t i=0; i<records.size(); ++i) {
+        if(!records[i]) return false;
+        names[i] = records[i]->getRecordName();
+    }
+    std::sort(names.begin(),names.end());
+    if(std::adjacent_find(names.begin(),names.end())!=names.end()) return false;
+    {
+        epicsGuard<epics::pvData::Mutex> guard(mutex);
+        for(size_t i=0; i<names.size(); ++i) {
+            if(isNameUsed(names[i])) return false;
+        }
+        pendingNames.insert(names.begin(),names.end());
+    }
+    StartTask task(records);
+    try {
+        runInParallel(task,records.size(),numberThreads,"PVDatabase::addRecords");
+    } catch(...) {
+        // undo the records that did start, none of them is in the database
+        for(size_t i=0; i<records.size(); ++i) {
+            if(!task.started[i]) continue;
+            try {
+                records[i]->remove();
+            } catch(std::exception & e) {
+                cout << "PVDatabase::addRecords remove " << names[i]
+                     << " " << e.what() << endl;
+            }
+        }
+        epicsGuard<epics::pvData::Mutex> guard(mutex);
+        for(size_t i=0; i<names.size(); ++i) pendingNames.erase(names[i]);
+        throw;
+    }
     epicsGuard<epics::pvData::Mutex> guard(mutex);
+    for(size_t i=0; i<records.size(); ++i) {
+        PVRecordPtr const & record = records[i];
+        if(record->getTraceLevel()>0) {
+            cout << "PVDatabase::addRecords " << record->getRecordName() << endl;
+        }
+        string recordName = record->getRecordName();
+        RecordShard & shard = getShard(recordName);
+        epicsGuard<epics::pvData::Mutex> shardGuard(shard.mutex);
+        shard.recordMap.insert(PVRecordMap::value_type(recordName,record));
+        pendingNames.erase(recordName);
+    }
+    epicsAtomicIncrSizeT(&generation);
+    return true;
+}
+
+PVRecordPtrArray PVDatabase::createRecords(
+    PVRecordCreator & creator,
+    size_t numberRecords,
+    size_t numberThreads)
+{
+    PVRecordPtrArray records(numberRecords);
+    CreateTask task(creator,records);
+    runInParallel(task,numberRecords,numberThreads,"PVDatabase::createRecords");
+    return records;
+}
+
+PVRecordWPtr PVDatabase::removeFromMap(PVRecordPtr const & record)
+{
     string recordName = record->getRecordName();
-    PVRecordMap::iterator iter = recordMap.find(recordName);
-    if(iter!=recordMap.end())  {
+    RecordShard & shard = getShard(recordName);
+    epicsGuard<epics::pvData::Mutex> guard(shard.mutex);
+    PVRecordMap::iterator iter = shard.recordMap.find(recordName);
+    if(iter!=shard.recordMap.end())  {
         PVRecordPtr pvRecord = (*iter).second;
-        recordMap.erase(iter);
+        shard.recordMap.erase(iter);
+        epicsAtomicIncrSizeT(&generation);
         return pvRecord->shared_from_this();
     }
     return PVRecordWPtr();
@@ -112,31 +433,103 @@ bool PVDatabase::removeRecord(PVRecordPtr const & record)
     if(record->getTraceLevel()>0) {
         cout << "PVDatabase::removeRecord " << record->getRecordName() << endl;
     }
-    epicsGuard<epics::pvData::Mutex> guard(mutex);
-    PVRecordWPtr pvRecord = removeFromMap(record);
-    if(pvRecord.use_count()!=0) {
-        pvRecord.lock()->unlistenClients();
-        return true;
+    PVRecordPtr pvRecord;
+    {
+        epicsGuard<epics::pvData::Mutex> guard(mutex);
+        pvRecord = removeFromMap(record).lock();
     }
-    return false;
+    if(!pvRecord) return false;
+    reap(pvRecord);
+    return true;
+}
+
+size_t PVDatabase::removeRecords(PVRecordPtrArray const & records)
+{
+    PVRecordPtrArray removed;
+    {
+        epicsGuard<epics::pvData::Mutex> guard(mutex);
+        for(size_t i=0; i<records.size(); ++i) {
+            if(records[i]->getTraceLevel()>0) {
+                cout << "PVDatabase::removeRecords " << records[i]->getRecordName() << endl;
+            }
+            PVRecordPtr pvRecord = removeFromMap(records[i]).lock();
+            if(pvRecord) removed.push_back(pvRecord);
+        }
+    }
+    for(size_t i=0; i<removed.size(); ++i) reap(removed[i]);
+    return removed.size();
 }
 
 PVStringArrayPtr PVDatabase::getRecordNames()
 {
-    epicsGuard<epics::pvData::Mutex> guard(mutex);
-    PVStringArrayPtr xxx;
     PVStringArrayPtr pvStringArray = static_pointer_cast<PVStringArray>
         (getPVDataCreate()->createPVScalarArray(pvString));
-    size_t len = recordMap.size();
-    shared_vector<string> names(len);
-    PVRecordMap::iterator iter;
-    size_t i = 0;
-    for(iter = recordMap.begin(); iter!=recordMap.end(); ++iter) {
-        names[i++] = (*iter).first;
-    }
-    shared_vector<const string> temp(freeze(names));
-    pvStringArray->replace(temp);
+    pvStringArray->replace(getRecordNameList());
     return pvStringArray;
 }
 
+PVStringArray::const_svector PVDatabase::getRecordNameList()
+{
+    epicsGuard<epics::pvData::Mutex> guard(namesMutex);
+    // Read the generation before the shards. A change made while
+    // the names are collected is picked up by the next call.
+    size_t current = epicsAtomicGetSizeT(&generation);
+    if(current==namesGeneration) return recordNames;
+    vector<string> names;
+    for(size_t i=0; i<numberShards; ++i) {
+        epicsGuard<epics::pvData::Mutex> guard(shards[i].mutex);
+        PVRecordMap const & recordMap = shards[i].recordMap;
+        PVRecordMap::const_iterator iter;
+        for(iter = recordMap.begin(); iter!=recordMap.end(); ++iter) {
+            names.push_back((*iter).first);
+        }
+    }
+    std::sort(names.begin(),names.end());
+    shared_vector<string> temp(names.size());
+    std::copy(names.begin(),names.end(),temp.begin());
+    recordNames = freeze(temp);
+    namesGeneration = current;
+    return recordNames;
+}
+
+PVStringArray::const_svector PVDatabase::findRecords(string const & pattern)
+{
+    PVStringArray::const_svector names(getRecordNameList());
+    string prefix(pattern.substr(0,pattern.find_first_of("*?[\\")));
+    PVStringArray::const_svector::const_iterator begin =
+        std::lower_bound(names.begin(),names.end(),prefix);
+    PVStringArray::const_svector::const_iterator end = begin;
+    while(end!=names.end() && end->compare(0,prefix.size(),prefix)==0) ++end;
+    if(pattern==prefix || pattern==prefix + "*") {
+        // every name in the range matches, share the list
+        if(pattern==prefix) end = (begin!=end && *begin==pattern) ? begin + 1 : begin;
+        names.slice(begin-names.begin(),end-begin);
+        return names;
+    }
+    shared_vector<string> matches;
+    for(; begin!=end; ++begin) {
+        if(epicsStrGlobMatch(begin->c_str(),pattern.c_str())) matches.push_back(*begin);
+    }
+    return freeze(matches);
+}
+
+size_t PVDatabase::setSnapshotEnabled(string const & pattern,bool enabled)
+{
+    PVStringArray::const_svector names(findRecords(pattern));
+    size_t number = 0;
+    for(size_t i=0; i<names.size(); ++i) {
+        PVRecordPtr pvRecord = findRecord(names[i]);
+        if(!pvRecord) continue;
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvRecord->setSnapshotEnabled(enabled);
+        ++number;
+    }
+    return number;
+}
+
+size_t PVDatabase::getGeneration()
+{
+    return epicsAtomicGetSizeT(&generation);
+}
+
 }}
@@ -0,0 +1,209 @@
+/* pvDatabaseSnapshot.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <map>
+
+#include <epicsGuard.h>
+#include <epicsEndian.h>
+#include <pv/pvData.h>
+#include <pv/serialize.h>
+
+#define epicsExportSharedSymbols
+#include "pv/pvDatabase.h"
+
+using namespace epics::pvData;
+using namespace std;
+
+namespace epics { namespace pvDatabase {
+
+namespace {
+
+// File layout, all integers are big endian epicsUInt32:
+//   magic, version, incremental, number of records
+//   then for each record:
+//     name length, name,
+//     introspection length, introspection (the Structure serialized big endian),
+//     data length, data (the top level PVStructure serialized big endian)
+const char magic[] = "PVDBSNAP";
+const size_t magicLength = 8;
+const epicsUInt32 version = 2;
+
+void writeUInt32(ostream & out,epicsUInt32 value)
+{
+    char buffer[4];
+    buffer[0] = static_cast<char>(value>>24);
+    buffer[1] = static_cast<char>(value>>16);
+    buffer[2] = static_cast<char>(value>>8);
+    buffer[3] = static_cast<char>(value);
+    out.write(buffer,4);
+}
+
+epicsUInt32 readUInt32(istream & in)
+{
+    unsigned char buffer[4];
+    in.read(reinterpret_cast<char *>(buffer),4);
+    if(!in) throw std::runtime_error("snapshot file is truncated");
+    return (epicsUInt32(buffer[0])<<24) | (epicsUInt32(buffer[1])<<16)
+         | (epicsUInt32(buffer[2])<<8) | epicsUInt32(buffer[3]);
+}
+
+// Reads a length and checks that the file has that many bytes left,
+// so that a corrupt length does not allocate more than the file size.
+size_t readLength(istream & in,streamoff fileSize)
+{
+    epicsUInt32 length = readUInt32(in);
+    streamoff position = in.tellg();
+    if(position<0 || streamoff(length)>fileSize-position) {
+        throw std::runtime_error("snapshot file has a length beyond its end");
+    }
+    return length;
+}
+
+void writeBytes(ostream & out,vector<epicsUInt8> const & bytes)
+{
+    writeUInt32(out,static_cast<epicsUInt32>(bytes.size()));
+    if(!bytes.empty()) {
+        out.write(reinterpret_cast<const char *>(&bytes[0]),bytes.size());
+    }
+}
+
+void readBytes(istream & in,streamoff fileSize,vector<epicsUInt8> & bytes)
+{
+    bytes.resize(readLength(in,fileSize));
+    if(!bytes.empty()) in.read(reinterpret_cast<char *>(&bytes[0]),bytes.size());
+}
+
+// A record chosen by saveSnapshot and the change count it was saved at.
+struct SavedRecord {
+    PVRecordPtr pvRecord;
+    size_t changeCount;
+};
+
+} // namespace
+
+size_t PVDatabase::saveSnapshot(string const & fileName,bool incremental)
+{
+    epicsGuard<epics::pvData::Mutex> guard(snapshotMutex);
+    PVStringArray::const_svector names(getRecordNameList());
+    vector<SavedRecord> saved;
+    saved.reserve(names.size());
+    for(size_t i=0; i<names.size(); ++i) {
+        SavedRecord savedRecord;
+        savedRecord.pvRecord = findRecord(names[i]);
+        if(!savedRecord.pvRecord) continue;
+        savedRecord.changeCount = savedRecord.pvRecord->getChangeCount();
+        if(incremental) {
+            map<string,size_t>::const_iterator iter = savedChangeCount.find(names[i]);
+            if(iter!=savedChangeCount.end()
+            && iter->second==savedRecord.changeCount) continue;
+        }
+        saved.push_back(savedRecord);
+    }
+    string tmpName(fileName + ".tmp");
+    ofstream out(tmpName.c_str(),ios::out|ios::binary|ios::trunc);
+    if(!out) throw std::runtime_error("can not create " + tmpName);
+    out.write(magic,magicLength);
+    writeUInt32(out,version);
+    writeUInt32(out,incremental ? 1 : 0);
+    writeUInt32(out,static_cast<epicsUInt32>(saved.size()));
+    vector<epicsUInt8> introspection;
+    vector<epicsUInt8> data;
+    for(size_t i=0; i<saved.size(); ++i) {
+        PVRecordPtr const & pvRecord = saved[i].pvRecord;
+        PVStructurePtr pvStructure = pvRecord->getPVStructure();
+        introspection.clear();
+        serializeToVector(pvStructure->getStructure().get(),EPICS_ENDIAN_BIG,introspection);
+        data.clear();
+        {
+            PVRecordSharedGuard guard(*pvRecord);
+            // changes between choosing the record and now are in the data
+            saved[i].changeCount = pvRecord->getChangeCount();
+            serializeToVector(pvStructure.get(),EPICS_ENDIAN_BIG,data);
+        }
+        string const & recordName = pvRecord->getRecordName();
+        writeUInt32(out,static_cast<epicsUInt32>(recordName.size()));
+        out.write(recordName.data(),recordName.size());
+        writeBytes(out,introspection);
+        writeBytes(out,data);
+    }
+    out.close();
+    if(!out) {
+        std::remove(tmpName.c_str());
+        throw std::runtime_error("can not write " + tmpName);
+    }
+    if(std::rename(tmpName.c_str(),fileName.c_str())!=0) {
+        // rename does not replace an existing file on all systems
+        std::remove(fileName.c_str());
+        if(std::rename(tmpName.c_str(),fileName.c_str())!=0) {
+            throw std::runtime_error("can not rename " + tmpName + " to " + fileName);
+        }
+    }
+    if(!incremental) savedChangeCount.clear();
+    for(size_t i=0; i<saved.size(); ++i) {
+        savedChangeCount[saved[i].pvRecord->getRecordName()] = saved[i].changeCount;
+    }
+    return saved.size();
+}
+
+size_t PVDatabase::restoreSnapshot(string const & fileName)
+{
+    ifstream in(fileName.c_str(),ios::in|ios::binary);
+    if(!in) throw std::runtime_error("can not open " + fileName);
+    in.seekg(0,ios::end);
+    streamoff fileSize = in.tellg();
+    in.seekg(0,ios::beg);
+    char header[magicLength];
+    in.read(header,magicLength);
+    if(!in || memcmp(header,magic,magicLength)!=0) {
+        throw std::runtime_error(fileName + " is not a snapshot file");
+    }
+    if(readUInt32(in)!=version) {
+        throw std::runtime_error(fileName + " has an unsupported version");
+    }
+    readUInt32(in);
+    epicsUInt32 numberRecords = readUInt32(in);
+    size_t numberRestored = 0;
+    string recordName;
+    vector<epicsUInt8> savedIntrospection;
+    vector<epicsUInt8> introspection;
+    vector<epicsUInt8> data;
+    for(epicsUInt32 n=0; n<numberRecords; ++n) {
+        recordName.resize(readLength(in,fileSize));
+        if(!recordName.empty()) in.read(&recordName[0],recordName.size());
+        readBytes(in,fileSize,savedIntrospection);
+        readBytes(in,fileSize,data);
+        if(!in) throw std::runtime_error(fileName + " is truncated");
+        PVRecordPtr pvRecord = findRecord(recordName);
+        if(!pvRecord) continue;
+        PVStructurePtr pvStructure = pvRecord->getPVStructure();
+        // the record must have the structure it had when it was saved,
+        // not only the same number of fields
+        introspection.clear();
+        serializeToVector(pvStructure->getStructure().get(),EPICS_ENDIAN_BIG,introspection);
+        if(introspection!=savedIntrospection) continue;
+        PVStructurePtr pvValue =
+            getPVDataCreate()->createPVStructure(pvStructure->getStructure());
+        try {
+            deserializeFromVector(pvValue.get(),EPICS_ENDIAN_BIG,data);
+        } catch(std::exception &) {
+            continue;
+        }
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvRecord->beginGroupPut();
+        pvStructure->copyUnchecked(*pvValue);
+        pvRecord->endGroupPut();
+        ++numberRestored;
+    }
+    return numberRestored;
+}
+
+}}
@@ -9,8 +9,12 @@
  * @date 2012.11.21
  */
 #include <list>
+#include <vector>
+#include <algorithm>
 #include <epicsGuard.h>
 #include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <epicsTime.h>
 #include <pv/status.h>
 #include <pv/pvAccess.h>
 #include <pv/createRequest.h>
@@ -27,6 +31,7 @@
 #define epicsExportSharedSymbols
 #include "pv/pvStructureCopy.h"
 #include "pv/pvDatabase.h"
+#include "pv/pvRecordTrace.h"
 
 using std::tr1::static_pointer_cast;
 using namespace epics::pvData;
@@ -35,6 +40,143 @@ using namespace std;
 
 namespace epics { namespace pvDatabase {
 
+// Listener lists are copy on write.
+// Code that posts takes a reference to the current snapshot and iterates it,
+// so a listener that is added or removed while posting does not disturb it.
+
+static PVListenerWPtrArrayConstPtr addToListenerList(
+    PVListenerWPtrArrayConstPtr const & pvListenerList,
+    PVListenerPtr const & pvListener)
+{
+    PVListenerWPtrArray *newList = new PVListenerWPtrArray();
+    if(pvListenerList) {
+        newList->reserve(pvListenerList->size() + 1);
+        PVListenerWPtrArray::const_iterator iter;
+        for(iter = pvListenerList->begin(); iter!=pvListenerList->end(); ++iter) {
+            if(!iter->expired()) newList->push_back(*iter);
+        }
+    }
+    newList->push_back(pvListener);
+    return PVListenerWPtrArrayConstPtr(newList);
+}
+
+static bool removeFromListenerList(
+    PVListenerWPtrArrayConstPtr & pvListenerList,
+    PVListenerPtr const & pvListener)
+{
+    if(!pvListenerList) return false;
+    bool found = false;
+    PVListenerWPtrArray *newList = new PVListenerWPtrArray();
+    newList->reserve(pvListenerList->size());
+    PVListenerWPtrArray::const_iterator iter;
+    for(iter = pvListenerList->begin(); iter!=pvListenerList->end(); ++iter) {
+        PVListenerPtr listener = iter->lock();
+        if(!listener) continue;
+        if(!found && listener.get()==pvListener.get()) {
+            found = true;
+            continue;
+        }
+        newList->push_back(*iter);
+    }
+    if(!found) {
+        delete newList;
+        return false;
+    }
+    if(newList->empty()) {
+        delete newList;
+        pvListenerList.reset();
+    } else {
+        pvListenerList = PVListenerWPtrArrayConstPtr(newList);
+    }
+    return true;
+}
+
+// Metadata that only depends on the introspection interface of the
+// top level structure. It is built for the first record with a given
+// Structure and shared by later records with the same Structure.
+class PVRecordLayout
+{
+public:
+    explicit PVRecordLayout(StructureConstPtr const & introspection)
+    : introspection(introspection),
+      firstLeafOffset(string::npos)
+    {
+        add(introspection,string::npos,string());
+    }
+    // keeps the cache key valid
+    StructureConstPtr introspection;
+    // indexed by field offset, string::npos for the top level structure
+    vector<size_t> parentOffset;
+    vector<string> fullFieldName;
+    // listeners of the top level structure are called before this field's
+    size_t firstLeafOffset;
+private:
+    // fields are added in field offset order
+    void add(
+        StructureConstPtr const & parentIntrospection,
+        size_t parent,
+        string const & name)
+    {
+        size_t offset = parentOffset.size();
+        parentOffset.push_back(parent);
+        fullFieldName.push_back(name);
+        FieldConstPtrArray const & fields = parentIntrospection->getFields();
+        StringArray const & names = parentIntrospection->getFieldNames();
+        for(size_t i=0; i<fields.size(); ++i) {
+            string fieldName = name.empty() ? names[i] : name + '.' + names[i];
+            if(fields[i]->getType()==epics::pvData::structure) {
+                add(static_pointer_cast<const Structure>(fields[i]),offset,fieldName);
+                continue;
+            }
+            if(firstLeafOffset==string::npos) firstLeafOffset = parentOffset.size();
+            parentOffset.push_back(offset);
+            fullFieldName.push_back(fieldName);
+        }
+    }
+};
+
+namespace {
+
+struct LayoutCache {
+    epics::pvData::Mutex mutex;
+    std::map<const Structure *,std::tr1::weak_ptr<const PVRecordLayout> > layouts;
+};
+
+LayoutCache * layoutCache = 0;
+epicsThreadOnceId layoutCacheOnce = EPICS_THREAD_ONCE_INIT;
+
+void createLayoutCache(void *)
+{
+    layoutCache = new LayoutCache();
+}
+
+PVRecordLayoutConstPtr getLayout(StructureConstPtr const & structure)
+{
+    epicsThreadOnce(&layoutCacheOnce,createLayoutCache,0);
+    epicsGuard<epics::pvData::Mutex> guard(layoutCache->mutex);
+    std::tr1::weak_ptr<const PVRecordLayout> & entry =
+        layoutCache->layouts[structure.get()];
+    PVRecordLayoutConstPtr layout(entry.lock());
+    if(layout) return layout;
+    layout = PVRecordLayoutConstPtr(new PVRecordLayout(structure));
+    entry = layout;
+    // drop entries of structures no record uses anymore
+    if(layoutCache->layouts.size()%256==0) {
+        std::map<const Structure *,std::tr1::weak_ptr<const PVRecordLayout> >::iterator
+            iter = layoutCache->layouts.begin();
+        while(iter!=layoutCache->layouts.end()) {
+            if(iter->second.expired()) {
+                layoutCache->layouts.erase(iter++);
+            } else {
+                ++iter;
+            }
+        }
+    }
+    return layout;
+}
+
+} // namespace
+
 PVRecordPtr PVRecord::create(
     string const &recordName,
     PVStructurePtr const & pvStructure,
@@ -49,6 +191,9 @@ PVRecordPtr PVRecord::create(
 }
 
 
+// the last PVRecord::traceId, changed with epicsAtomic
+static size_t nextTraceId = 0;
+
 PVRecord::PVRecord(
     string const & recordName,
     PVStructurePtr const & pvStructure,
@@ -56,12 +201,28 @@ PVRecord::PVRecord(
     const std::string& asGroup_)
 : recordName(recordName),
   pvStructure(pvStructure),
+  depthLock(0),
+  numberReaders(0),
+  statsRequested(0),
+  numberProcess(0),
+  numberGroupPut(0),
+  numberLock(0),
+  numberLockWait(0),
+  processTime(0),
+  lockWaitTime(0),
+  changeCount(0),
+  numberListenedFields(0),
+  snapshotEnabled(false),
+  snapshotDirty(false),
+  snapshotVersion(0),
   depthGroupPut(0),
   traceLevel(0),
+  traceId(epicsAtomicIncrSizeT(&nextTraceId)),
   isAddListener(false),
   asLevel(asLevel_),
   asGroup(asGroup_)
 {
+    for(size_t i=0; i<PVRecordStats::numberProcessBins; ++i) processHistogram[i] = 0;
 }
 
 PVRecord::~PVRecord()
@@ -74,18 +235,34 @@ PVRecord::~PVRecord()
 void PVRecord::unlistenClients()
 {
     epicsGuard<epics::pvData::Mutex> guard(mutex);
-    for(std::list<PVListenerWPtr>::iterator iter = pvListenerList.begin();
-         iter!=pvListenerList.end();
-         iter++ )
-    {
-        PVListenerPtr listener = iter->lock();
-        if(!listener) continue;
-        if(traceLevel>0) {
-            cout << "PVRecord::remove() calling listener->unlisten " << recordName << endl;
+    PVListenerWPtrArrayConstPtr listeners(pvListenerList);
+    pvListenerList.reset();
+    PVListenerWPtrArrayConstPtr changeSetListeners(changeSetListenerList);
+    changeSetListenerList.reset();
+    if(changeSetListeners) {
+        PVListenerWPtrArray::const_iterator iter;
+        for(iter = changeSetListeners->begin(); iter!=changeSetListeners->end(); ++iter)
+        {
+            PVListenerPtr listener = iter->lock();
+            if(!listener) continue;
+            if(traceLevel>0) {
+                cout << "PVRecord::remove() calling changeSetListener->unlisten " << recordName << endl;
+            }
+            listener->unlisten(shared_from_this());
+        }
+    }
+    if(listeners) {
+        PVListenerWPtrArray::const_iterator iter;
+        for(iter = listeners->begin(); iter!=listeners->end(); ++iter)
+        {
+            PVListenerPtr listener = iter->lock();
+            if(!listener) continue;
+            if(traceLevel>0) {
+                cout << "PVRecord::remove() calling listener->unlisten " << recordName << endl;
+            }
+            listener->unlisten(shared_from_this());
         }
-        listener->unlisten(shared_from_this());
     }
-    pvListenerList.clear();
     for (std::list<PVRecordClientWPtr>::iterator iter = clientList.begin();
          iter!=clientList.end();
          iter++ )
@@ -115,9 +292,11 @@ void PVRecord::remove()
 
 void PVRecord::initPVRecord()
 {
-    PVRecordStructurePtr parent;
+    layout = getLayout(pvStructure->getStructure());
+    pvRecordFieldTable.assign(pvStructure->getNumberFields(),PVRecordFieldPtr());
+    changeSetBitSet = BitSetPtr(new BitSet(pvStructure->getNumberFields()));
     pvRecordStructure = PVRecordStructurePtr(
-        new PVRecordStructure(pvStructure,parent,shared_from_this()));
+        new PVRecordStructure(pvStructure,shared_from_this()));
     pvRecordStructure->init();
     PVFieldPtr pvField = pvStructure->getSubField("timeStamp");
     if(pvField) pvTimeStamp.attach(pvField);
@@ -138,61 +317,145 @@ void PVRecord::process()
 
 PVRecordFieldPtr PVRecord::findPVRecordField(PVFieldPtr const & pvField)
 {
-    return findPVRecordField(pvRecordStructure,pvField);
+    size_t offset = pvField->getFieldOffset();
+    if(offset>=pvRecordFieldTable.size()) {
+        throw std::logic_error(
+            recordName + " pvField "
+            + pvField->getFieldName() + " not in PVRecord");
+    }
+    return pvRecordFieldTable[offset];
 }
 
-PVRecordFieldPtr PVRecord::findPVRecordField(
-    PVRecordStructurePtr const & pvrs,
-        PVFieldPtr const & pvField)
+PVRecordFieldPtr PVRecord::findPVRecordField(size_t fieldOffset)
 {
-    size_t desiredOffset = pvField->getFieldOffset();
-    PVFieldPtr pvf = pvrs->getPVField();
-    size_t offset = pvf->getFieldOffset();
-    if(offset==desiredOffset) return pvrs;
-    PVRecordFieldPtrArrayPtr  pvrfpap = pvrs->getPVRecordFields();
-    PVRecordFieldPtrArray::iterator iter;
-    for (iter = pvrfpap.get()->begin(); iter!=pvrfpap.get()->end(); iter++ ) {
-        PVRecordFieldPtr pvrf = *iter;
-        pvf = pvrf->getPVField();
-        offset = pvf->getFieldOffset();
-        if(offset==desiredOffset) return pvrf;
-        size_t nextOffset = pvf->getNextFieldOffset();
-        if(nextOffset<=desiredOffset) continue;
-        return findPVRecordField(
-            static_pointer_cast<PVRecordStructure>(pvrf),
-            pvField);
+    if(fieldOffset>=pvRecordFieldTable.size()) {
+        throw std::logic_error(
+            recordName + " field offset not in PVRecord");
     }
-    throw std::logic_error(
-        recordName + " pvField "
-        + pvField->getFieldName() + " not in PVRecord");
+    return pvRecordFieldTable[fieldOffset];
 }
 
+// The exclusive lock is mutex plus waiting for readers to leave.
+// Readers take mutex only long enough to register themselves,
+// so a writer that is waiting for readers blocks new readers.
+
 void PVRecord::lock() {
-    if(traceLevel>2) {
-        cout << "PVRecord::lock() " << recordName << endl;
+    if(traceLevel>2) PVRecordTrace::record(this,traceLock);
+    // the clock is only read if the lock is not free
+    epicsUInt64 start = 0;
+    if(!mutex.tryLock()) {
+        start = epicsMonotonicGet();
+        mutex.lock();
+    }
+    if(depthLock++==0 && epicsAtomicGetIntT(&numberReaders)>0) {
+        if(start==0) start = epicsMonotonicGet();
+        while(epicsAtomicGetIntT(&numberReaders)>0) readersDone.wait();
+    }
+    epicsAtomicIncrSizeT(&numberLock);
+    if(start!=0) {
+        epicsAtomicIncrSizeT(&numberLockWait);
+        lockWaitTime += epicsMonotonicGet()-start;
     }
-    mutex.lock();
 }
 
 void PVRecord::unlock() {
-    if(traceLevel>2) {
-        cout << "PVRecord::unlock() " << recordName << endl;
-    }
+    if(traceLevel>2) PVRecordTrace::record(this,traceUnlock);
+    if(depthLock==1 && snapshotDirty && depthGroupPut==0) publishSnapshot();
+    --depthLock;
     mutex.unlock();
 }
 
 bool PVRecord::tryLock() {
-    if(traceLevel>2) {
-        cout << "PVRecord::tryLock() " << recordName << endl;
+    if(traceLevel>2) PVRecordTrace::record(this,traceTryLock);
+    if(!mutex.tryLock()) return false;
+    if(depthLock==0 && epicsAtomicGetIntT(&numberReaders)>0) {
+        mutex.unlock();
+        return false;
+    }
+    ++depthLock;
+    epicsAtomicIncrSizeT(&numberLock);
+    return true;
+}
+
+void PVRecord::lockShared() {
+    if(traceLevel>2) PVRecordTrace::record(this,traceLockShared);
+    epicsGuard<epics::pvData::Mutex> guard(mutex);
+    epicsAtomicIncrIntT(&numberReaders);
+}
+
+void PVRecord::unlockShared() {
+    if(traceLevel>2) PVRecordTrace::record(this,traceUnlockShared);
+    if(epicsAtomicDecrIntT(&numberReaders)==0) readersDone.signal();
+}
+
+void PVRecord::timedProcess()
+{
+    if(!epicsAtomicGetIntT(&statsRequested)) {
+        process();
+        epicsAtomicIncrSizeT(&numberProcess);
+        return;
+    }
+    epicsUInt64 start = epicsMonotonicGet();
+    process();
+    epicsUInt64 time = epicsMonotonicGet() - start;
+    epicsAtomicIncrSizeT(&numberProcess);
+    // the caller holds the lock
+    processTime += time;
+    size_t bin = 0;
+    epicsUInt64 limit = 1000;
+    while(bin<PVRecordStats::numberProcessBins-1 && time>=limit) {
+        ++bin;
+        limit *= 10;
     }
-    return mutex.tryLock();
+    epicsAtomicIncrSizeT(&processHistogram[bin]);
 }
 
-void PVRecord::lockOtherRecord(PVRecordPtr const & otherRecord)
+PVRecordStats PVRecord::getStats()
 {
-    if(traceLevel>2) {
-        cout << "PVRecord::lockOtherRecord() " << recordName << endl;
+    epicsAtomicSetIntT(&statsRequested,1);
+    PVRecordStats stats;
+    stats.numberProcess = epicsAtomicGetSizeT(&numberProcess);
+    for(size_t i=0; i<PVRecordStats::numberProcessBins; ++i) {
+        stats.processHistogram[i] = epicsAtomicGetSizeT(&processHistogram[i]);
+    }
+    stats.numberGroupPut = epicsAtomicGetSizeT(&numberGroupPut);
+    stats.numberLock = epicsAtomicGetSizeT(&numberLock);
+    stats.numberLockWait = epicsAtomicGetSizeT(&numberLockWait);
+    // released after the guard, a listener may be destroyed with it
+    std::vector<PVListenerPtr> listeners;
+    epicsGuard<epics::pvData::Mutex> guard(mutex);
+    stats.processTime = processTime*1e-9;
+    stats.lockWaitTime = lockWaitTime*1e-9;
+    PVListenerWPtrArrayConstPtr lists[] = {pvListenerList,changeSetListenerList};
+    for(size_t i=0; i<2; ++i) {
+        if(!lists[i]) continue;
+        PVListenerWPtrArray::const_iterator iter;
+        for(iter = lists[i]->begin(); iter!=lists[i]->end(); ++iter) {
+            PVListenerPtr listener = iter->lock();
+            if(listener) listeners.push_back(listener);
+        }
+    }
+    stats.numberListeners = listeners.size();
+    stats.numberMonitors = 0;
+    for(size_t i=0; i<listeners.size(); ++i) {
+        stats.numberMonitors += listeners[i]->getNumberMonitors();
     }
+    stats.numberClients = 0;
+    std::list<PVRecordClientWPtr>::const_iterator iter;
+    for(iter = clientList.begin(); iter!=clientList.end(); ++iter) {
+        if(!iter->expired()) ++stats.numberClients;
+    }
+    return stats;
+}
+
+size_t PVRecord::getChangeCount()
+{
+    return epicsAtomicGetSizeT(&changeCount);
+}
+
+void PVRecord::lockOtherRecord(PVRecordPtr const & otherRecord)
+{
+    if(traceLevel>2) PVRecordTrace::record(this,traceLockOtherRecord);
     if(this<otherRecord.get()) {
         otherRecord->lock();
         return;
@@ -241,7 +504,7 @@ bool PVRecord::addListener(
         cout << "PVRecord::addListener() " << recordName << endl;
     }
     epicsGuard<epics::pvData::Mutex> guard(mutex);
-    pvListenerList.push_back(pvListener);
+    pvListenerList = addToListenerList(pvListenerList,pvListener);
     this->pvListener = pvListener;
     isAddListener = true;
     pvCopy->traverseMaster(shared_from_this());
@@ -269,53 +532,182 @@ bool PVRecord::removeListener(
         cout << "PVRecord::removeListener() " << recordName << endl;
     }
     epicsGuard<epics::pvData::Mutex> guard(mutex);
-    std::list<PVListenerWPtr>::iterator iter;
-    for (iter = pvListenerList.begin(); iter!=pvListenerList.end(); iter++ )
-    {
-        PVListenerPtr listener = iter->lock();
-        if(!listener.get()) continue;
-        if(listener.get()==pvListener.get()) {
-            pvListenerList.erase(iter);
-            this->pvListener = pvListener;
-            isAddListener = false;
-            pvCopy->traverseMaster(shared_from_this());
-            this->pvListener = PVListenerPtr();
-            return true;
+    if(!removeFromListenerList(pvListenerList,pvListener)) return false;
+    this->pvListener = pvListener;
+    isAddListener = false;
+    pvCopy->traverseMaster(shared_from_this());
+    this->pvListener = PVListenerPtr();
+    return true;
+}
+
+bool PVRecord::addChangeSetListener(PVListenerPtr const & pvListener)
+{
+    if(traceLevel>1) {
+        cout << "PVRecord::addChangeSetListener() " << recordName << endl;
+    }
+    epicsGuard<epics::pvData::Mutex> guard(mutex);
+    changeSetListenerList = addToListenerList(changeSetListenerList,pvListener);
+    return true;
+}
+
+bool PVRecord::removeChangeSetListener(PVListenerPtr const & pvListener)
+{
+    if(traceLevel>1) {
+        cout << "PVRecord::removeChangeSetListener() " << recordName << endl;
+    }
+    epicsGuard<epics::pvData::Mutex> guard(mutex);
+    if(!removeFromListenerList(changeSetListenerList,pvListener)) return false;
+    if(!changeSetListenerList) changeSetBitSet->clear();
+    return true;
+}
+
+void PVRecord::postChangeSet(size_t fieldOffset)
+{
+    // only called with the record locked, so a plain store is enough
+    epicsAtomicSetSizeT(&changeCount,changeCount+1);
+    if(snapshotEnabled) snapshotDirty = true;
+    if(!changeSetListenerList) return;
+    changeSetBitSet->set(fieldOffset);
+    if(depthGroupPut>0) return;
+    callChangeSetListeners();
+}
+
+void PVRecord::callChangeSetListeners()
+{
+    PVListenerWPtrArrayConstPtr listeners(changeSetListenerList);
+    if(listeners && changeSetBitSet->nextSetBit(0)>=0) {
+        PVRecordPtr self(shared_from_this());
+        PVListenerWPtrArray::const_iterator iter;
+        for (iter = listeners->begin(); iter!=listeners->end(); ++iter)
+        {
+            PVListenerPtr listener = iter->lock();
+            if(!listener.get()) continue;
+            listener->dataPutChangeSet(self,changeSetBitSet);
         }
     }
-    return false;
+    changeSetBitSet->clear();
+}
+
+void PVRecord::setSnapshotEnabled(bool enabled)
+{
+    if(traceLevel>1) {
+        cout << "PVRecord::setSnapshotEnabled() " << recordName
+             << " " << (enabled ? "true" : "false") << endl;
+    }
+    snapshotEnabled = enabled;
+    if(enabled) {
+        publishSnapshot();
+        return;
+    }
+    snapshotDirty = false;
+    spareSnapshot.reset();
+    epicsGuard<epics::pvData::Mutex> guard(snapshotMutex);
+    snapshot.reset();
+}
+
+PVRecordSnapshotPtr PVRecord::getSnapshot()
+{
+    epicsGuard<epics::pvData::Mutex> guard(snapshotMutex);
+    return snapshot;
+}
+
+void PVRecord::publishSnapshot()
+{
+    PVRecordSnapshotPtr next;
+    if(spareSnapshot && spareSnapshot.unique()) {
+        // no client holds it and it is no longer published
+        next.swap(spareSnapshot);
+        next->pvStructure->copyUnchecked(*pvStructure);
+    } else {
+        spareSnapshot.reset();
+        next = PVRecordSnapshotPtr(new PVRecordSnapshot(
+            getPVDataCreate()->createPVStructure(pvStructure)));
+    }
+    next->version = ++snapshotVersion;
+    snapshotDirty = false;
+    epicsGuard<epics::pvData::Mutex> guard(snapshotMutex);
+    spareSnapshot.swap(snapshot);
+    snapshot.swap(next);
 }
 
 void PVRecord::beginGroupPut()
 {
    if(++depthGroupPut>1) return;
-    if(traceLevel>2) {
-        cout << "PVRecord::beginGroupPut() " << recordName << endl;
-    }
-   std::list<PVListenerWPtr>::iterator iter;
-   for (iter = pvListenerList.begin(); iter!=pvListenerList.end(); iter++)
+   epicsAtomicIncrSizeT(&numberGroupPut);
+    if(traceLevel>2) PVRecordTrace::record(this,traceBeginGroupPut);
+   PVListenerWPtrArrayConstPtr listeners(pvListenerList);
+   if(!listeners) return;
+   PVRecordPtr self(shared_from_this());
+   PVListenerWPtrArray::const_iterator iter;
+   for (iter = listeners->begin(); iter!=listeners->end(); ++iter)
    {
        PVListenerPtr listener = iter->lock();
        if(!listener.get()) continue;
-       listener->beginGroupPut(shared_from_this());
+       listener->beginGroupPut(self);
    }
 }
 
 void PVRecord::endGroupPut()
 {
    if(--depthGroupPut>0) return;
-    if(traceLevel>2) {
-        cout << "PVRecord::endGroupPut() " << recordName << endl;
-    }
-   std::list<PVListenerWPtr>::iterator iter;
-   for (iter = pvListenerList.begin(); iter!=pvListenerList.end(); iter++)
+    if(traceLevel>2) PVRecordTrace::record(this,traceEndGroupPut);
+   if(changeSetListenerList) callChangeSetListeners();
+   if(snapshotDirty) publishSnapshot();
+   PVListenerWPtrArrayConstPtr listeners(pvListenerList);
+   if(!listeners) return;
+   PVRecordPtr self(shared_from_this());
+   PVListenerWPtrArray::const_iterator iter;
+   for (iter = listeners->begin(); iter!=listeners->end(); ++iter)
    {
        PVListenerPtr listener = iter->lock();
        if(!listener.get()) continue;
-       listener->endGroupPut(shared_from_this());
+       listener->endGroupPut(self);
    }
 }
 
+static bool lockOrder(PVRecordPtr const & left,PVRecordPtr const & right)
+{
+    return left.get() < right.get();
+}
+
+static bool sameRecord(PVRecordPtr const & left,PVRecordPtr const & right)
+{
+    return left.get() == right.get();
+}
+
+// The order is the address order also used by PVRecord::lockOtherRecord.
+PVRecordLockSet::PVRecordLockSet(PVRecordPtrArray const & records)
+{
+    pvRecords.reserve(records.size());
+    for(size_t i=0; i<records.size(); ++i) {
+        if(records[i]) pvRecords.push_back(records[i]);
+    }
+    std::sort(pvRecords.begin(),pvRecords.end(),lockOrder);
+    pvRecords.erase(
+        std::unique(pvRecords.begin(),pvRecords.end(),sameRecord),
+        pvRecords.end());
+}
+
+void PVRecordLockSet::lock()
+{
+    for(size_t i=0; i<pvRecords.size(); ++i) pvRecords[i]->lock();
+}
+
+void PVRecordLockSet::unlock()
+{
+    for(size_t i=pvRecords.size(); i>0; --i) pvRecords[i-1]->unlock();
+}
+
+void PVRecordLockSet::beginGroupPut()
+{
+    for(size_t i=0; i<pvRecords.size(); ++i) pvRecords[i]->beginGroupPut();
+}
+
+void PVRecordLockSet::endGroupPut()
+{
+    for(size_t i=0; i<pvRecords.size(); ++i) pvRecords[i]->endGroupPut();
+}
+
 std::ostream& operator<<(std::ostream& o, const PVRecord& record)
 {
     o << format::indent() << "record " << record.getRecordName() << endl;
@@ -326,49 +718,58 @@ std::ostream& operator<<(std::ostream& o, const PVRecord& record)
     return o;
 }
 
+PVRecordField::PVRecordField(
+    PVFieldPtr const & pvField,
+    PVRecordPtr const & pvRecord)
+:  pvField(pvField),
+   pvRecord(pvRecord),
+   isStructure(pvField->getField()->getType()==structure ? true : false)
+{
+}
+
 PVRecordField::PVRecordField(
     PVFieldPtr const & pvField,
     PVRecordStructurePtr const &parent,
     PVRecordPtr const & pvRecord)
 :  pvField(pvField),
-   isStructure(pvField->getField()->getType()==structure ? true : false),
-   master(),
-   parent(parent),
-   pvRecord(pvRecord)
+   pvRecord(pvRecord),
+   isStructure(pvField->getField()->getType()==structure ? true : false)
 {
 }
 
 void PVRecordField::init()
 {
-    fullFieldName = pvField.lock()->getFieldName();
-    PVRecordStructurePtr pvParent(parent.lock());
-    while(pvParent) {
-        string parentName = pvParent->getPVField()->getFieldName();
-        if(parentName.size()>0) {
-            fullFieldName = pvParent->getPVField()->getFieldName()
-                + '.' + fullFieldName;
-        }
-        pvParent = pvParent->getParent();
-    }
     PVRecordPtr pvRecord(this->pvRecord.lock());
-    if(fullFieldName.size()>0) {
-        fullName = pvRecord->getRecordName() + '.' + fullFieldName;
-    } else {
-        fullName = pvRecord->getRecordName();
-    }
-    pvField.lock()->setPostHandler(shared_from_this());
+    PVFieldPtr pvField(this->pvField.lock());
+    pvRecord->pvRecordFieldTable[pvField->getFieldOffset()] = shared_from_this();
+    pvField->setPostHandler(shared_from_this());
 }
 
 PVRecordStructurePtr PVRecordField::getParent()
 {
-    return parent.lock();
+    PVRecordPtr pvRecord(this->pvRecord.lock());
+    if(!pvRecord) return PVRecordStructurePtr();
+    size_t offset = pvRecord->layout->parentOffset[pvField.lock()->getFieldOffset()];
+    if(offset==string::npos) return PVRecordStructurePtr();
+    return static_pointer_cast<PVRecordStructure>(
+        pvRecord->pvRecordFieldTable[offset]);
 }
 
 PVFieldPtr PVRecordField::getPVField() {return pvField.lock();}
 
-string PVRecordField::getFullFieldName() {return fullFieldName; }
+string PVRecordField::getFullFieldName()
+{
+    PVRecordPtr pvRecord(this->pvRecord.lock());
+    return pvRecord->layout->fullFieldName[pvField.lock()->getFieldOffset()];
+}
 
-string PVRecordField::getFullName() {return fullName; }
+string PVRecordField::getFullName()
+{
+    string fullFieldName(getFullFieldName());
+    string recordName(pvRecord.lock()->getRecordName());
+    if(fullFieldName.size()>0) return recordName + '.' + fullFieldName;
+    return recordName;
+}
 
 PVRecordPtr PVRecordField::getPVRecord() {return pvRecord.lock();}
 
@@ -378,7 +779,8 @@ bool PVRecordField::addListener(PVListenerPtr const & pvListener)
     if(pvRecord && pvRecord->getTraceLevel()>1) {
          cout << "PVRecordField::addListener() " << getFullName() << endl;
     }
-    pvListenerList.push_back(pvListener);
+    if(pvRecord && !pvListenerList) ++pvRecord->numberListenedFields;
+    pvListenerList = addToListenerList(pvListenerList,pvListener);
     return true;
 }
 
@@ -388,48 +790,51 @@ void PVRecordField::removeListener(PVListenerPtr const & pvListener)
     if(pvRecord && pvRecord->getTraceLevel()>1) {
          cout << "PVRecordField::removeListener() " << getFullName() << endl;
     }
-    std::list<PVListenerWPtr>::iterator iter;
-    for (iter = pvListenerList.begin(); iter!=pvListenerList.end(); iter++ ) {
-        PVListenerPtr listener = iter->lock();
-        if(!listener.get()) continue;
-        if(listener.get()==pvListener.get()) {
-            pvListenerList.erase(iter);
-            return;
-        }
-    }
+    if(removeFromListenerList(pvListenerList,pvListener)
+    && pvRecord && !pvListenerList) --pvRecord->numberListenedFields;
 }
 
 void PVRecordField::postPut()
 {
-    PVRecordStructurePtr parent(this->parent.lock());;
-    if(parent) {
-        parent->postParent(shared_from_this());
+    PVRecordPtr pvRecord(this->pvRecord.lock());
+    if(!pvRecord) return;
+    size_t offset = pvField.lock()->getFieldOffset();
+    pvRecord->postChangeSet(offset);
+    // no field of the record has a listener
+    if(pvRecord->numberListenedFields==0) return;
+    // walk the parents through the layout of the record already held
+    // instead of calling getParent, which locks pvRecord for every hop
+    PVRecordFieldPtr self(shared_from_this());
+    vector<size_t> const & parentOffset = pvRecord->layout->parentOffset;
+    for(size_t parent = parentOffset[offset];
+        parent!=string::npos;
+        parent = parentOffset[parent])
+    {
+        pvRecord->pvRecordFieldTable[parent]->postParent(self);
     }
-    postSubField();
+    postSubField(*pvRecord);
 }
 
 void PVRecordField::postParent(PVRecordFieldPtr const & subField)
 {
+    PVListenerWPtrArrayConstPtr listeners(pvListenerList);
+    if(!listeners) return;
     PVRecordStructurePtr pvrs = static_pointer_cast<PVRecordStructure>(shared_from_this());
-    std::list<PVListenerWPtr>::iterator iter;
-    for(iter = pvListenerList.begin(); iter != pvListenerList.end(); ++iter)
+    PVListenerWPtrArray::const_iterator iter;
+    for(iter = listeners->begin(); iter != listeners->end(); ++iter)
     {
         PVListenerPtr listener = iter->lock();
         if(!listener.get()) continue;
         listener->dataPut(pvrs,subField);
     }
-    PVRecordStructurePtr parent(this->parent.lock());
-    if(parent) {
-        parent->postParent(subField);
-    }
 }
 
-void PVRecordField::postSubField()
+void PVRecordField::postSubField(PVRecord & pvRecord)
 {
-    // Master field pointer will be set in only one subfield
-    PVRecordStructurePtr master(this->master.lock());
-    if(master) {
-        master->callListener();
+    // Listeners of the top level structure are called
+    // before the listeners of the first subfield
+    if(pvRecord.layout->firstLeafOffset==pvField.lock()->getFieldOffset()) {
+        pvRecord.getPVRecordStructure()->callListener();
     }
     callListener();
     if(isStructure) {
@@ -438,28 +843,39 @@ void PVRecordField::postSubField()
         PVRecordFieldPtrArrayPtr pvRecordFields = pvrs->getPVRecordFields();
         PVRecordFieldPtrArray::iterator iter;
         for(iter = pvRecordFields->begin() ; iter !=pvRecordFields->end(); iter++) {
-             (*iter)->postSubField();
+             (*iter)->postSubField(pvRecord);
         }
     }
 }
 
 void PVRecordField::callListener()
 {
-    std::list<PVListenerWPtr>::iterator iter;
-    for (iter = pvListenerList.begin(); iter!=pvListenerList.end(); iter++ ) {
+    PVListenerWPtrArrayConstPtr listeners(pvListenerList);
+    if(!listeners) return;
+    PVRecordFieldPtr self(shared_from_this());
+    PVListenerWPtrArray::const_iterator iter;
+    for (iter = listeners->begin(); iter!=listeners->end(); ++iter) {
         PVListenerPtr listener = iter->lock();
         if(!listener.get()) continue;
-        listener->dataPut(shared_from_this());
+        listener->dataPut(self);
     }
 }
 
+PVRecordStructure::PVRecordStructure(
+    PVStructurePtr const &pvStructure,
+    PVRecordPtr const & pvRecord)
+:
+    PVRecordField(pvStructure,pvRecord),
+    pvRecordFields(new PVRecordFieldPtrArray)
+{
+}
+
 PVRecordStructure::PVRecordStructure(
     PVStructurePtr const &pvStructure,
     PVRecordStructurePtr const &parent,
     PVRecordPtr const & pvRecord)
 :
-    PVRecordField(pvStructure,parent,pvRecord),
-    pvStructure(pvStructure),
+    PVRecordField(pvStructure,pvRecord),
     pvRecordFields(new PVRecordFieldPtrArray)
 {
 }
@@ -467,44 +883,25 @@ PVRecordStructure::PVRecordStructure(
 void PVRecordStructure::init()
 {
     PVRecordField::init();
-    const PVFieldPtrArray & pvFields = pvStructure.lock()->getPVFields();
+    const PVFieldPtrArray & pvFields = getPVStructure()->getPVFields();
     size_t numFields = pvFields.size();
     pvRecordFields->reserve( numFields);
     PVRecordStructurePtr self =
         static_pointer_cast<PVRecordStructure>(shared_from_this());
     PVRecordPtr pvRecord = getPVRecord();
-    static bool masterFieldCallbackSet = false;
-    bool isMasterField = (!getFullFieldName().size());
-    if (isMasterField) {
-        masterFieldCallbackSet = false;
-    }
     for(size_t i=0; i<numFields; i++) {
         PVFieldPtr pvField = pvFields[i];
         if(pvField->getField()->getType()==structure) {
             PVStructurePtr xxx = static_pointer_cast<PVStructure>(pvField);
             PVRecordStructurePtr pvRecordStructure(
-                 new PVRecordStructure(xxx,self,pvRecord));
+                 new PVRecordStructure(xxx,pvRecord));
             pvRecordFields->push_back(pvRecordStructure);
             pvRecordStructure->init();
         } else {
             PVRecordFieldPtr pvRecordField(
-                new PVRecordField(pvField,self,pvRecord));
+                new PVRecordField(pvField,pvRecord));
             pvRecordFields->push_back(pvRecordField);
             pvRecordField->init();
-            // Master field listeners will be called before
-            // calling listeners for the first subfield
-            if (!masterFieldCallbackSet) {
-                masterFieldCallbackSet = true;
-                // Find master field
-                PVRecordStructurePtr p = pvRecordField->parent.lock();
-                while (p) {
-                    PVRecordStructurePtr p2 = p->parent.lock();
-                    if (!p2) {
-                        pvRecordField->master = p;
-                    }
-                    p = p2;
-                }
-            }
         }
     }
 }
@@ -514,6 +911,9 @@ PVRecordFieldPtrArrayPtr PVRecordStructure::getPVRecordFields()
     return pvRecordFields;
 }
 
-PVStructurePtr PVRecordStructure::getPVStructure() {return pvStructure.lock();}
+PVStructurePtr PVRecordStructure::getPVStructure()
+{
+    return static_pointer_cast<PVStructure>(getPVField());
+}
 
 }}
@@ -0,0 +1,234 @@
+/* pvRecordTrace.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+#include <algorithm>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsAtomic.h>
+#include <epicsGuard.h>
+#include <pv/lock.h>
+
+#define epicsExportSharedSymbols
+#include "pv/pvDatabase.h"
+#include "pv/pvRecordTrace.h"
+
+using std::string;
+using std::vector;
+
+namespace epics { namespace pvDatabase {
+
+namespace {
+
+// must be a power of 2
+const size_t ringSize = 1024;
+// The most rings that are created. Threads that are not EPICS threads
+// never give their ring back, so after this rings are shared.
+const size_t maxRings = 64;
+
+struct TraceSlot {
+    // 0 while the slot is written, otherwise the index of the event plus 1
+    size_t sequence;
+    epicsUInt64 time;
+    size_t recordId;
+    epicsUInt32 op;
+    epicsUInt32 fieldOffset;
+};
+
+// A writer takes a slot by incrementing head, so a ring can be
+// shared by threads.
+// A reader copies a slot and then checks that its sequence did not
+// change, so an event overwritten while it was copied is left out.
+// When the owner exits, or when maxRings is reached, the ring is
+// reused by another thread.
+// The events before first belong to a previous owner.
+struct TraceRing {
+    TraceRing() : head(0), first(0)
+    {
+        for(size_t i=0; i<ringSize; ++i) slots[i].sequence = 0;
+    }
+    TraceSlot slots[ringSize];
+    size_t head;
+    // first and threadName are written with TraceRings::mutex held
+    size_t first;
+    string threadName;
+};
+
+// Rings are never freed, so a reader can always use them.
+// The ring of an EPICS thread that exited is on freeRings until another
+// thread takes it. epicsAtThreadExit is not called for other threads,
+// so once there are maxRings rings a new thread takes the ring that
+// was taken longest ago, which may still be written by its owner.
+struct TraceRings {
+    TraceRings() : nextShared(0) {}
+    epicsThreadPrivateId threadPrivate;
+    epics::pvData::Mutex mutex;
+    vector<TraceRing *> rings;
+    vector<TraceRing *> freeRings;
+    // rings are taken in order of this index when all rings are in use
+    size_t nextShared;
+};
+
+TraceRings * traceRings = 0;
+epicsThreadOnceId traceRingsOnce = EPICS_THREAD_ONCE_INIT;
+
+void createTraceRings(void *)
+{
+    traceRings = new TraceRings();
+    traceRings->threadPrivate = epicsThreadPrivateCreate();
+}
+
+TraceRings & getTraceRings()
+{
+    epicsThreadOnce(&traceRingsOnce,createTraceRings,0);
+    return *traceRings;
+}
+
+void epicsStdCall releaseThreadRing(void * arg)
+{
+    TraceRings & rings = getTraceRings();
+    epicsGuard<epics::pvData::Mutex> guard(rings.mutex);
+    rings.freeRings.push_back(static_cast<TraceRing *>(arg));
+}
+
+TraceRing * getThreadRing()
+{
+    TraceRings & rings = getTraceRings();
+    TraceRing * ring = static_cast<TraceRing *>(
+        epicsThreadPrivateGet(rings.threadPrivate));
+    if(ring) return ring;
+    bool isShared = false;
+    {
+        epicsGuard<epics::pvData::Mutex> guard(rings.mutex);
+        if(!rings.freeRings.empty()) {
+            ring = rings.freeRings.back();
+            rings.freeRings.pop_back();
+        } else if(rings.rings.size()<maxRings) {
+            ring = new TraceRing();
+            rings.rings.push_back(ring);
+        } else {
+            // rings are created in order, so this starts with the oldest
+            ring = rings.rings[rings.nextShared];
+            rings.nextShared = (rings.nextShared+1)%maxRings;
+            isShared = true;
+        }
+        ring->first = epicsAtomicGetSizeT(&ring->head);
+        ring->threadName = epicsThreadGetNameSelf();
+    }
+    epicsThreadPrivateSet(rings.threadPrivate,ring);
+    // a shared ring must not be put on freeRings when one of its threads exits
+    if(!isShared) epicsAtThreadExit(releaseThreadRing,ring);
+    return ring;
+}
+
+// A ring and what getEvents read of it with TraceRings::mutex held.
+struct RingRange {
+    TraceRing * ring;
+    size_t first;
+    size_t end;
+    string threadName;
+};
+
+bool earlier(PVRecordTraceEvent const & left,PVRecordTraceEvent const & right)
+{
+    return left.time < right.time;
+}
+
+const char * opNames[] = {
+    "lock",
+    "unlock",
+    "tryLock",
+    "lockShared",
+    "unlockShared",
+    "lockOtherRecord",
+    "beginGroupPut",
+    "endGroupPut",
+    "monitorDataPut",
+    "monitorBeginGroupPut",
+    "monitorEndGroupPut",
+    "monitorPoll",
+    "monitorRelease",
+    "monitorReleaseActive",
+    "channelProcess",
+    "channelGet",
+    "channelPut",
+    "channelPutGet",
+    "channelGetArray",
+    "channelPutArray",
+    "channelSetLength"
+};
+
+} // namespace
+
+void PVRecordTrace::record(
+    const PVRecord * pvRecord,
+    PVRecordTraceOp op,
+    size_t fieldOffset)
+{
+    TraceRing * ring = getThreadRing();
+    size_t head = epicsAtomicIncrSizeT(&ring->head)-1;
+    TraceSlot & slot = ring->slots[head & (ringSize-1)];
+    epicsAtomicSetSizeT(&slot.sequence,0);
+    epicsAtomicWriteMemoryBarrier();
+    slot.time = epicsMonotonicGet();
+    slot.recordId = pvRecord->getTraceId();
+    slot.op = op;
+    slot.fieldOffset = static_cast<epicsUInt32>(fieldOffset);
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetSizeT(&slot.sequence,head+1);
+}
+
+void PVRecordTrace::getEvents(
+    const PVRecord * pvRecord,
+    vector<PVRecordTraceEvent> & events)
+{
+    TraceRings & traceRings = getTraceRings();
+    vector<RingRange> ranges;
+    {
+        // a ring taken over after this only has events from end on
+        epicsGuard<epics::pvData::Mutex> guard(traceRings.mutex);
+        ranges.resize(traceRings.rings.size());
+        for(size_t i=0; i<ranges.size(); ++i) {
+            TraceRing * ring = traceRings.rings[i];
+            ranges[i].ring = ring;
+            ranges[i].first = ring->first;
+            ranges[i].end = epicsAtomicGetSizeT(&ring->head);
+            ranges[i].threadName = ring->threadName;
+        }
+    }
+    size_t recordId = pvRecord->getTraceId();
+    size_t firstEvent = events.size();
+    for(size_t i=0; i<ranges.size(); ++i) {
+        RingRange const & range = ranges[i];
+        size_t begin = range.end>ringSize ? range.end-ringSize : 0;
+        if(begin<range.first) begin = range.first;
+        for(size_t n=begin; n<range.end; ++n) {
+            TraceSlot const & slot = range.ring->slots[n & (ringSize-1)];
+            size_t sequence = epicsAtomicGetSizeT(&slot.sequence);
+            epicsAtomicReadMemoryBarrier();
+            TraceSlot copy = slot;
+            epicsAtomicReadMemoryBarrier();
+            // overwritten by a later event, or being written
+            if(sequence!=n+1 || epicsAtomicGetSizeT(&slot.sequence)!=sequence) continue;
+            if(copy.recordId!=recordId) continue;
+            PVRecordTraceEvent event;
+            event.time = copy.time;
+            event.recordId = copy.recordId;
+            event.op = copy.op;
+            event.fieldOffset = copy.fieldOffset;
+            event.threadName = range.threadName;
+            events.push_back(event);
+        }
+    }
+    std::sort(events.begin()+firstEvent,events.end(),earlier);
+}
+
+const char * PVRecordTrace::getOpName(epicsUInt32 op)
+{
+    if(op>=sizeof(opNames)/sizeof(opNames[0])) return "unknown";
+    return opNames[op];
+}
+
+}}
@@ -44,6 +44,53 @@ epicsShareFunc epics::pvData::MonitorPtr createMonitorLocal(
     epics::pvData::MonitorRequester::shared_pointer const & monitorRequester,
     epics::pvData::PVStructurePtr const & pvRequest);
 
+/**
+ * @brief Statistics of a monitor created by createMonitorLocal.
+ *
+ * Returned by getMonitorLocalStats.
+ * The counts are since the monitor was last started.
+ */
+struct epicsShareClass MonitorLocalStats
+{
+    /**
+     * The number of elements the client can hold now, polled or not.
+     * It is the limit Monitor::getStats reports as nfilled+noutstanding+nempty,
+     * and is between minQueueSize and maxQueueSize.
+     */
+    std::size_t queueSize;
+    /**
+     * record._options.queueSize less one,
+     * since the monitor holds one element for the next update.
+     */
+    std::size_t minQueueSize;
+    /**
+     * record._options.maxQueueSize less one.
+     * If it is greater than minQueueSize, queueSize is doubled each time
+     * an update finds the queue full and halved while the client
+     * holds less than a quarter of it.
+     */
+    std::size_t maxQueueSize;
+    /** Number of queued updates not yet polled. */
+    std::size_t numberUsed;
+    /** Number of times an update found the queue full. */
+    std::size_t numberOverflow;
+    /** Number of queued updates with a field set in overrunBitSet. */
+    std::size_t numberOverrun;
+    /** Total number of fields set in the overrunBitSet of the queued updates. */
+    std::size_t numberOverrunFields;
+};
+
+/**
+ * @brief Get the statistics of a monitor.
+ *
+ * @param monitor A monitor created by createMonitorLocal.
+ * @param stats The statistics.
+ * @return false if the monitor was not created by createMonitorLocal.
+ */
+epicsShareFunc bool getMonitorLocalStats(
+    epics::pvData::MonitorPtr const & monitor,
+    MonitorLocalStats & stats);
+
 epicsShareFunc ChannelProviderLocalPtr getChannelProviderLocal();
 
 
@@ -113,6 +160,18 @@ public:
      */
     virtual epics::pvAccess::ChannelFind::shared_pointer channelList(
         epics::pvAccess::ChannelListRequester::shared_pointer const & channelListRequester);
+    /**
+     * @brief Calls method channelListRequester::channelListResult
+     * with the names of the records that match a pattern.
+     *
+     * See PVDatabase::findRecords.
+     * @param channelListRequester The client callback.
+     * @param pattern The pattern, for example "SR01:BPM*".
+     * @return shared pointer to ChannelFind.
+     */
+    epics::pvAccess::ChannelFind::shared_pointer channelList(
+        epics::pvAccess::ChannelListRequester::shared_pointer const & channelListRequester,
+        std::string const & pattern);
     /**
      * @brief Create a channel for a record.
      *
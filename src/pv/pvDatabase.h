@@ -7,9 +7,15 @@
 #define PVDATABASE_H
 
 #include <list>
+#include <vector>
 #include <map>
+#include <set>
+
+#include <epicsEvent.h>
+#include <epicsThread.h>
 
 #include <pv/pvData.h>
+#include <pv/bitSet.h>
 #include <pv/pvTimeStamp.h>
 #include <pv/rpcService.h>
 #include <pv/pvStructureCopy.h>
@@ -22,6 +28,7 @@ class PVRecord;
 typedef std::tr1::shared_ptr<PVRecord> PVRecordPtr;
 typedef std::tr1::weak_ptr<PVRecord> PVRecordWPtr;
 typedef std::map<std::string,PVRecordPtr> PVRecordMap;
+typedef std::vector<PVRecordPtr> PVRecordPtrArray;
 
 class PVRecordField;
 typedef std::tr1::shared_ptr<PVRecordField> PVRecordFieldPtr;
@@ -39,6 +46,53 @@ typedef std::tr1::weak_ptr<PVRecordClient> PVRecordClientWPtr;
 class PVListener;
 typedef std::tr1::shared_ptr<PVListener> PVListenerPtr;
 typedef std::tr1::weak_ptr<PVListener> PVListenerWPtr;
+typedef std::vector<PVListenerWPtr> PVListenerWPtrArray;
+typedef std::tr1::shared_ptr<const PVListenerWPtrArray> PVListenerWPtrArrayConstPtr;
+
+class PVRecordSnapshot;
+typedef std::tr1::shared_ptr<PVRecordSnapshot> PVRecordSnapshotPtr;
+
+class PVRecordLayout;
+typedef std::tr1::shared_ptr<const PVRecordLayout> PVRecordLayoutConstPtr;
+
+/**
+ * @brief Statistics of a record.
+ *
+ * Returned by PVRecord::getStats.
+ * The counts are since the record was created.
+ */
+struct epicsShareClass PVRecordStats
+{
+    /**
+     * The number of bins in processHistogram.
+     * Bin i counts calls that took less than 10**i microseconds,
+     * the last bin counts the rest.
+     */
+    static const std::size_t numberProcessBins = 8;
+    /** Number of calls to process made with timedProcess. */
+    std::size_t numberProcess;
+    /** Total time of the calls in processHistogram in seconds. */
+    double processTime;
+    /** Histogram of the process time. */
+    std::size_t processHistogram[numberProcessBins];
+    /** Number of outer beginGroupPut calls. */
+    std::size_t numberGroupPut;
+    /** Number of calls to lock and successful calls to tryLock. */
+    std::size_t numberLock;
+    /** Number of calls to lock that had to wait. */
+    std::size_t numberLockWait;
+    /** Total time lock waited in seconds. */
+    double lockWaitTime;
+    /**
+     * Number of listener objects, including change set listeners.
+     * Monitors that share a copy of the record have one listener.
+     */
+    std::size_t numberListeners;
+    /** Number of monitors the listeners deliver to. */
+    std::size_t numberMonitors;
+    /** Number of clients. */
+    std::size_t numberClients;
+};
 
 class PVDatabase;
 typedef std::tr1::shared_ptr<PVDatabase> PVDatabasePtr;
@@ -87,6 +141,30 @@ public:
      *  the base class sets the timeStamp to the current time.
      */
     virtual void process();
+    /**
+     * @brief Call process and update the process statistics.
+     *
+     * The caller must hold the lock.
+     * The time spent in process is only measured after getStats
+     * has been called once.
+     */
+    void timedProcess();
+    /**
+     * @brief Get the statistics of the record.
+     *
+     * The record lock is not required.
+     * @return The statistics.
+     */
+    PVRecordStats getStats();
+    /**
+     * @brief Get the number of field changes posted since the record was created.
+     *
+     * The record lock is not required.
+     * PVDatabase::saveSnapshot uses it to find the records changed
+     * since the previous snapshot.
+     * @return The count.
+     */
+    std::size_t getChangeCount();
     /**
      *  @brief remove record from database.
      *
@@ -148,10 +226,20 @@ public:
      */
     PVRecordFieldPtr findPVRecordField(
         epics::pvData::PVFieldPtr const & pvField);
+    /**
+     * @brief Find the PVRecordField for a field offset.
+     *
+     * The lookup is a single index into a table built by initPVRecord.
+     * @param fieldOffset The offset of the field in the top level PVStructure.
+     * @return The shared pointer to the PVRecordField.
+     */
+    PVRecordFieldPtr findPVRecordField(std::size_t fieldOffset);
     /**
      * @brief Lock the record.
      *
      * Any code must lock while accessing a record.
+     * This is the exclusive lock. It waits until all shared locks are released.
+     * It must be used by code that modifies the record or calls process.
      */
     void lock();
     /**
@@ -160,6 +248,19 @@ public:
      * The code that calls lock must unlock when done accessing the record.
      */
     void unlock();
+    /**
+     * @brief Lock the record for reading.
+     *
+     * Any number of threads can hold the shared lock at the same time.
+     * A thread that holds the shared lock <b>must</b> not modify the record
+     * and <b>must</b> not call lock before calling unlockShared.
+     * A thread that holds the exclusive lock can also take the shared lock.
+     */
+    void lockShared();
+    /**
+     * @brief Release a lock taken by lockShared.
+     */
+    void unlockShared();
     /**
      * @brief Try to lock the record.
      *
@@ -178,6 +279,7 @@ public:
      * more then one record.
      *
      * @param otherRecord The other record to lock.
+     * @see PVRecordLockSet for locking more than two records.
      */
     void lockOtherRecord(PVRecordPtr const & otherRecord);
     /**
@@ -216,8 +318,46 @@ public:
     bool removeListener(
         PVListenerPtr const & pvListener,
         epics::pvCopy::PVCopyPtr const & pvCopy);
-
+    /**
+     * @brief Add a listener that is given aggregated change sets.
+     *
+     * Instead of a dataPut call for each field posted, the listener gets
+     * one dataPutChangeSet call at the end of each group of puts,
+     * and one for each put that is not in a group of puts.
+     * @param pvListener The listener.
+     * @return <b>true</b> if the listener was added.
+     */
+    bool addChangeSetListener(PVListenerPtr const & pvListener);
+    /**
+     * @brief Remove a listener added by addChangeSetListener.
+     *
+     * @param pvListener The listener.
+     * @return <b>true</b> if the listener was removed.
+     */
+    bool removeChangeSetListener(PVListenerPtr const & pvListener);
 
+    /**
+     * @brief Enable or disable snapshots.
+     *
+     * When enabled the record publishes a copy of its top level PVStructure
+     * at the end of each group of puts and when the record is unlocked
+     * after puts outside a group put.
+     * The caller must hold the record lock.
+     * @param enabled (false,true) means (disable,enable) snapshots.
+     */
+    void setSnapshotEnabled(bool enabled);
+    /**
+     * @brief Are snapshots enabled?
+     * @return The answer.
+     */
+    bool isSnapshotEnabled() const {return snapshotEnabled;}
+    /**
+     * @brief Get the latest snapshot.
+     *
+     * The record lock is not required.
+     * @return The snapshot or null if snapshots are not enabled.
+     */
+    PVRecordSnapshotPtr getSnapshot();
     /**
      * @brief Begins a group of puts.
      */
@@ -231,8 +371,19 @@ public:
      * @return the level
      */
     int getTraceLevel() {return traceLevel;}
+    /**
+     * @brief Get the trace id of the record.
+     *
+     * No other record created by the process has the same id.
+     * PVRecordTrace uses it to select the events of a record.
+     * @return The id.
+     */
+    std::size_t getTraceId() const {return traceId;}
     /**
      * @brief set trace level (0,1,2) means (nothing,lifetime,process)
+     *
+     * Operations traced at level 2 and above are written to the
+     * binary trace ring, see PVRecordTrace.
      * @param level The level
      */
     void setTraceLevel(int level) {traceLevel = level;}
@@ -278,20 +429,62 @@ protected:
     void initPVRecord();
 private:
     friend class PVDatabase;
+    friend class PVRecordField;
     void unlistenClients();
-
-    PVRecordFieldPtr findPVRecordField(
-        PVRecordStructurePtr const & pvrs,
-        epics::pvData::PVFieldPtr const & pvField);
+    void postChangeSet(std::size_t fieldOffset);
+    void callChangeSetListeners();
+    void publishSnapshot();
 
     std::string recordName;
     epics::pvData::PVStructurePtr pvStructure;
     PVRecordStructurePtr pvRecordStructure;
-    std::list<PVListenerWPtr> pvListenerList;
+    // field metadata shared by all records with the same introspection
+    PVRecordLayoutConstPtr layout;
+    // indexed by field offset, filled by PVRecordField::init
+    PVRecordFieldPtrArray pvRecordFieldTable;
+    // immutable snapshot, replaced by addListener and removeListener
+    PVListenerWPtrArrayConstPtr pvListenerList;
+    PVListenerWPtrArrayConstPtr changeSetListenerList;
+    // offsets of fields posted since the last call to the changeSet listeners
+    epics::pvData::BitSetPtr changeSetBitSet;
+    bool snapshotEnabled;
+    // true if a field was posted since the last snapshot was published
+    bool snapshotDirty;
+    epics::pvData::uint64 snapshotVersion;
+    PVRecordSnapshotPtr snapshot;
+    // the previous snapshot, reused when no client still holds it
+    PVRecordSnapshotPtr spareSnapshot;
+    // only protects snapshot, never held while calling other code
+    epics::pvData::Mutex snapshotMutex;
     std::list<PVRecordClientWPtr> clientList;
     epics::pvData::Mutex mutex;
+    // number of exclusive locks held by the thread that owns mutex
+    std::size_t depthLock;
+    // number of shared locks, changed with epicsAtomic
+    int numberReaders;
+    // signaled when numberReaders goes to zero
+    epicsEvent readersDone;
+    // statistics, changed with epicsAtomic
+    int statsRequested;
+    std::size_t numberProcess;
+    std::size_t processHistogram[PVRecordStats::numberProcessBins];
+    std::size_t numberGroupPut;
+    std::size_t numberLock;
+    std::size_t numberLockWait;
+    // times in nanoseconds, changed and read with mutex held.
+    // A size_t would wrap after about 4 seconds on 32 bit targets.
+    epics::pvData::uint64 processTime;
+    epics::pvData::uint64 lockWaitTime;
+    // changed with the record locked, read with epicsAtomic
+    std::size_t changeCount;
+    // Number of fields with a listener added by addListener,
+    // changed with the record locked. postPut does not walk the parents
+    // and subfields of a field while it is zero. Monitors use change set
+    // listeners, so it is zero for monitored records too.
+    std::size_t numberListenedFields;
     std::size_t depthGroupPut;
     int traceLevel;
+    std::size_t traceId;
     // following only valid while addListener or removeListener is active.
     bool isAddListener;
     PVListenerWPtr pvListener;
@@ -305,6 +498,109 @@ private:
 
 epicsShareFunc std::ostream& operator<<(std::ostream& o, const PVRecord& record);
 
+/**
+ * @brief An immutable copy of the top level PVStructure of a record.
+ *
+ * Published by PVRecord when snapshots are enabled.
+ * The data <b>must</b> not be modified.
+ */
+class epicsShareClass PVRecordSnapshot
+{
+public:
+    POINTER_DEFINITIONS(PVRecordSnapshot);
+    /**
+     * @brief Get the copy of the record data.
+     * @return The top level PVStructure of the copy.
+     */
+    epics::pvData::PVStructurePtr const & getPVStructure() const {return pvStructure;}
+    /**
+     * @brief Get the version.
+     *
+     * The version is incremented each time the record publishes a snapshot.
+     * @return The version.
+     */
+    epics::pvData::uint64 getVersion() const {return version;}
+private:
+    friend class PVRecord;
+    PVRecordSnapshot(epics::pvData::PVStructurePtr const & pvStructure)
+    : pvStructure(pvStructure),
+      version(0)
+    {}
+    epics::pvData::PVStructurePtr pvStructure;
+    epics::pvData::uint64 version;
+};
+
+/**
+ * @brief Guard for the shared lock of a record.
+ *
+ * Like epicsGuard<PVRecord> but calls lockShared and unlockShared.
+ */
+class epicsShareClass PVRecordSharedGuard
+{
+public:
+    explicit PVRecordSharedGuard(PVRecord & pvRecord)
+    : pvRecord(pvRecord)
+    {
+        pvRecord.lockShared();
+    }
+    ~PVRecordSharedGuard()
+    {
+        pvRecord.unlockShared();
+    }
+private:
+    PVRecordSharedGuard(const PVRecordSharedGuard &);
+    PVRecordSharedGuard & operator=(const PVRecordSharedGuard &);
+    PVRecord & pvRecord;
+};
+
+/**
+ * @brief A set of records that are locked and put as a unit.
+ *
+ * The records are always locked in the same order,
+ * so two threads that lock overlapping sets can not deadlock.
+ * It can be used with epicsGuard<PVRecordLockSet>.
+ */
+class epicsShareClass PVRecordLockSet
+{
+public:
+    POINTER_DEFINITIONS(PVRecordLockSet);
+    /**
+     * @brief Constructor.
+     *
+     * Null and duplicate entries are ignored.
+     * @param pvRecords The records.
+     */
+    explicit PVRecordLockSet(PVRecordPtrArray const & pvRecords);
+    /**
+     * @brief Lock all the records.
+     */
+    void lock();
+    /**
+     * @brief Unlock all the records.
+     */
+    void unlock();
+    /**
+     * @brief Call beginGroupPut for all the records.
+     *
+     * The caller must hold the lock.
+     */
+    void beginGroupPut();
+    /**
+     * @brief Call endGroupPut for all the records.
+     *
+     * The caller must hold the lock.
+     * All listeners of all the records are notified before the lock is released.
+     */
+    void endGroupPut();
+    /**
+     * @brief Get the records in lock order.
+     * @return The records.
+     */
+    PVRecordPtrArray const & getPVRecords() const {return pvRecords;}
+private:
+    PVRecordPtrArray pvRecords;
+};
+
 /**
  * @brief Interface for a field of a record.
  *
@@ -320,8 +616,19 @@ public:
     /**
      * @brief  Constructor.
      *
+     * The parent is not kept, getParent finds it by field offset.
+     * @param pvField The field from the top level structure.
+     * @param pvRecord The PVRecord.
+     */
+    PVRecordField(
+        epics::pvData::PVFieldPtr const & pvField,
+        PVRecordPtr const & pvRecord);
+    /**
+     * @brief  Constructor.
+     *
+     * @deprecated parent is ignored, use the constructor without it.
      * @param pvField The field from the top level structure.
-     * @param parent The parent.
+     * @param parent Ignored.
      * @param pvRecord The PVRecord.
      */
     PVRecordField(
@@ -367,20 +674,19 @@ public:
 protected:
     virtual void init();
     virtual void postParent(PVRecordFieldPtr const & subField);
-    virtual void postSubField();
+    virtual void postSubField(PVRecord & pvRecord);
 private:
     bool addListener(PVListenerPtr const & pvListener);
     virtual void removeListener(PVListenerPtr const & pvListener);
     void callListener();
 
-    std::list<PVListenerWPtr> pvListenerList;
+    // One exists for every field of every record, so keep it small.
+    // Names and the parent come from the record layout, by field offset.
+    // immutable snapshot, replaced by addListener and removeListener
+    PVListenerWPtrArrayConstPtr pvListenerList;
     epics::pvData::PVField::weak_pointer pvField;
-    bool isStructure;
-    PVRecordStructureWPtr master;
-    PVRecordStructureWPtr parent;
     PVRecordWPtr pvRecord;
-    std::string fullName;
-    std::string fullFieldName;
+    bool isStructure;
     friend class PVRecordStructure;
     friend class PVRecord;
 };
@@ -397,7 +703,16 @@ public:
     /**
      * @brief Constructor.
      * @param pvStructure The data.
-     * @param parent The parent
+     * @param pvRecord The record that has this field.
+     */
+    PVRecordStructure(
+        epics::pvData::PVStructurePtr const &pvStructure,
+        PVRecordPtr const & pvRecord);
+    /**
+     * @brief Constructor.
+     * @deprecated parent is ignored, use the constructor without it.
+     * @param pvStructure The data.
+     * @param parent Ignored.
      * @param pvRecord The record that has this field.
      */
     PVRecordStructure(
@@ -424,7 +739,6 @@ protected:
      */
     virtual void init();
 private:
-    epics::pvData::PVStructure::weak_pointer pvStructure;
     PVRecordFieldPtrArrayPtr pvRecordFields;
     friend class PVRecord;
 };
@@ -467,28 +781,54 @@ public:
      * @brief pvField has been modified.
      *
      * This is called if the listener has called PVRecordField::addListener for pvRecordField.
+     * A listener added by PVRecord::addChangeSetListener need not implement it.
      * @param pvRecordField The modified field.
      */
-    virtual void dataPut(PVRecordFieldPtr const & pvRecordField) = 0;
+    virtual void dataPut(PVRecordFieldPtr const & pvRecordField) {}
     /**
      * @brief A subfield has been modified.
      *
+     * A listener added by PVRecord::addChangeSetListener need not implement it.
      * @param requested The structure that was requested.
      * @param pvRecordField The field that was modified.
      */
     virtual void dataPut(
         PVRecordStructurePtr const & requested,
-        PVRecordFieldPtr const & pvRecordField) = 0;
+        PVRecordFieldPtr const & pvRecordField) {}
     /**
      * @brief Begin a set of puts.
+     *
+     * A listener added by PVRecord::addChangeSetListener need not implement it.
      * @param pvRecord The record.
      */
-    virtual void beginGroupPut(PVRecordPtr const & pvRecord) = 0;
+    virtual void beginGroupPut(PVRecordPtr const & pvRecord) {}
     /**
      * @brief End a set of puts.
+     *
+     * A listener added by PVRecord::addChangeSetListener need not implement it.
+     * @param pvRecord The record.
+     */
+    virtual void endGroupPut(PVRecordPtr const & pvRecord) {}
+    /**
+     * @brief Fields of the record have been modified.
+     *
+     * This is called instead of the dataPut methods if the listener
+     * was added by PVRecord::addChangeSetListener.
+     * The record is locked and changedBitSet is only valid during the call.
      * @param pvRecord The record.
+     * @param changedBitSet The offsets, in the top level PVStructure,
+     * of the fields that were posted.
      */
-    virtual void endGroupPut(PVRecordPtr const & pvRecord) = 0;
+    virtual void dataPutChangeSet(
+        PVRecordPtr const & pvRecord,
+        epics::pvData::BitSetPtr const & changedBitSet) {}
+    /**
+     * @brief The number of monitors this listener delivers to.
+     *
+     * Used by PVRecord::getStats, which calls it with the record locked.
+     * @return 0 unless the listener implements a monitor.
+     */
+    virtual std::size_t getNumberMonitors() const {return 0;}
     /**
      * @brief Connection to record is being terminated.
      * @param pvRecord The record.
@@ -496,12 +836,31 @@ public:
     virtual void unlisten(PVRecordPtr const & pvRecord) = 0;
 };
 
+/**
+ * @brief Creates records for PVDatabase::createRecords.
+ *
+ * create is called concurrently by several threads,
+ * so it must not modify state shared between calls without locking.
+ */
+class epicsShareClass PVRecordCreator {
+public:
+    virtual ~PVRecordCreator() {}
+    /**
+     * @brief Create and initialize a record.
+     * @param index The index of the record.
+     * @return The record.
+     */
+    virtual PVRecordPtr create(std::size_t index) = 0;
+};
+
 /**
  * @brief The interface for a database of PVRecords.
  *
  * @author mrk
  */
-class epicsShareClass PVDatabase {
+class epicsShareClass PVDatabase :
+    private epicsThreadRunable
+{
 public:
     POINTER_DEFINITIONS(PVDatabase);
     /**
@@ -529,25 +888,177 @@ public:
     bool addRecord(PVRecordPtr const & record);
     /**
      * @brief Remove a record.
+     *
+     * The record is removed from the database before this returns.
+     * Its clients are detached by a reaper thread,
+     * so removing a record with many clients does not hold the database lock.
+     * See waitForRemovedRecords.
      * @param record The record to remove.
      *
      * @return <b>true</b> if record was removed.
      */
     bool removeRecord(PVRecordPtr const & record);
+    /**
+     * @brief Add several records.
+     *
+     * The names are checked in one pass and reserved under one lock.
+     * Then start is called for each record without holding the database lock,
+     * by the caller and up to numberThreads-1 threads of a shared thread pool.
+     * Finally all records are inserted under one lock.
+     * If start throws for any record, remove is called for each record
+     * that was started, none of the records are added and the exception
+     * is rethrown as std::runtime_error.
+     * @param records The records to add.
+     * @param numberThreads The number of threads that call start.
+     * @return <b>false</b> and no record added if records has an empty
+     * pointer or if a name is already in the database or appears more
+     * than once in records.
+     */
+    bool addRecords(PVRecordPtrArray const & records,std::size_t numberThreads = 1);
+    /**
+     * @brief Remove several records under one lock.
+     *
+     * As for removeRecord the clients are detached by the reaper thread.
+     * @param records The records to remove.
+     * @return The number of records that were removed.
+     */
+    std::size_t removeRecords(PVRecordPtrArray const & records);
+    /**
+     * @brief Wait until the clients of all removed records are detached.
+     *
+     * After the reaper thread is stopped at exit the clients are
+     * detached by removeRecord itself.
+     */
+    void waitForRemovedRecords();
+    /**
+     * @brief Create records with a pool of threads.
+     *
+     * creator.create is called once for each index in [0,numberRecords)
+     * by up to numberThreads threads.
+     * The records are not added to the database, see addRecords.
+     * @param creator Creates the record for an index.
+     * @param numberRecords The number of records.
+     * @param numberThreads The number of threads.
+     * @return The records in index order.
+     * @throws std::runtime_error if creator throws or returns an empty pointer.
+     */
+    static PVRecordPtrArray createRecords(
+        PVRecordCreator & creator,
+        std::size_t numberRecords,
+        std::size_t numberThreads = 1);
     /**
      * @brief Get the names of all the records in the database.
      * @return The names.
      */
     epics::pvData::PVStringArrayPtr getRecordNames();
+    /**
+     * @brief Get the sorted names of all the records in the database.
+     *
+     * The list is rebuilt only when records were added or removed
+     * since the last call. Otherwise the same frozen list is returned.
+     * @return The names.
+     */
+    epics::pvData::PVStringArray::const_svector getRecordNameList();
+    /**
+     * @brief Get the sorted names of the records that match a pattern.
+     *
+     * The pattern is matched by epicsStrGlobMatch.
+     * The characters before the first wildcard are a prefix that is
+     * looked up in the sorted record name list,
+     * so only the names with that prefix are matched against the pattern.
+     * @param pattern The pattern, for example "SR01:BPM*".
+     * @return The names.
+     */
+    epics::pvData::PVStringArray::const_svector findRecords(std::string const & pattern);
+    /**
+     * @brief Enable or disable snapshots of the records that match a pattern.
+     *
+     * Calls PVRecord::setSnapshotEnabled for each record found by findRecords.
+     * The iocsh command pvdbSnapshot calls it.
+     * @param pattern The pattern, for example "SR01:BPM*".
+     * @param enabled (false,true) means (disable,enable) snapshots.
+     * @return The number of records.
+     */
+    std::size_t setSnapshotEnabled(std::string const & pattern,bool enabled);
+    /**
+     * @brief Get the generation of the record names.
+     *
+     * It changes each time records are added or removed.
+     * @return The generation.
+     */
+    std::size_t getGeneration();
+    /**
+     * @brief Save the values of the records to a file.
+     *
+     * The introspection interface and the top level PVStructure of each
+     * record are written with pvData serialization,
+     * the data while the record holds a shared lock.
+     * The file is written to fileName.tmp and then renamed,
+     * so an existing file is replaced only by a complete snapshot.
+     * An incremental snapshot has only the records that changed,
+     * or were added, since the previous call of saveSnapshot.
+     * @param fileName The file.
+     * @param incremental Only write changed records.
+     * @return The number of records written.
+     * @throws std::runtime_error if the file can not be written.
+     */
+    std::size_t saveSnapshot(std::string const & fileName,bool incremental = false);
+    /**
+     * @brief Restore the values of the records from a file written by saveSnapshot.
+     *
+     * The values of each record are put with one group put.
+     * Records that are not in the database or whose introspection interface
+     * differs from the saved one are skipped.
+     * To restore incremental snapshots, restore the full snapshot
+     * and then the incremental snapshots in the order they were saved.
+     * @param fileName The file.
+     * @return The number of records restored.
+     * @throws std::runtime_error if the file can not be read, is not a snapshot
+     * or has a length beyond the end of the file.
+     */
+    std::size_t restoreSnapshot(std::string const & fileName);
 private:
     friend class PVRecord;
 
     PVRecordWPtr removeFromMap(PVRecordPtr const & record);
+    static void createMaster(void *);
     PVDatabase();
+    void reap(PVRecordPtr const & record);
+    virtual void run();
+    static void stopReaperAtExit(void * arg);
+    void stopReaper();
     void lock();
     void unlock();
-    PVRecordMap  recordMap;
+    // The records are spread over shards by a hash of the record name,
+    // so lookups of different names seldom wait for each other.
+    struct RecordShard {
+        epics::pvData::Mutex mutex;
+        PVRecordMap recordMap;
+    };
+    static const std::size_t numberShards = 64;
+    RecordShard & getShard(std::string const & recordName);
+    RecordShard shards[numberShards];
+    bool isNameUsed(std::string const & recordName);
+    // serializes addRecord and removeRecord
     epics::pvData::Mutex mutex;
+    // names reserved by addRecords while their records are started
+    std::set<std::string> pendingNames;
+    // recordNames is valid for namesGeneration
+    std::size_t generation;
+    epics::pvData::Mutex namesMutex;
+    std::size_t namesGeneration;
+    epics::pvData::PVStringArray::const_svector recordNames;
+    // change count of each record at the previous saveSnapshot
+    epics::pvData::Mutex snapshotMutex;
+    std::map<std::string,std::size_t> savedChangeCount;
+    // removed records whose clients are detached by the reaper thread
+    epics::pvData::Mutex reaperMutex;
+    std::list<PVRecordPtr> reaperQueue;
+    std::size_t reaperPending;
+    bool reaperStop;
+    epicsEvent reaperWakeup;
+    epicsEvent reaperDone;
+    std::tr1::shared_ptr<epicsThread> reaperThread;
     static bool getMasterFirstCall;
 };
 
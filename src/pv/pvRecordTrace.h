@@ -0,0 +1,117 @@
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+#ifndef PVRECORDTRACE_H
+#define PVRECORDTRACE_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+
+#include <shareLib.h>
+
+namespace epics { namespace pvDatabase {
+
+class PVRecord;
+
+/**
+ * @brief The operations recorded in the trace ring.
+ */
+enum PVRecordTraceOp {
+    traceLock,
+    traceUnlock,
+    traceTryLock,
+    traceLockShared,
+    traceUnlockShared,
+    traceLockOtherRecord,
+    traceBeginGroupPut,
+    traceEndGroupPut,
+    traceMonitorDataPut,
+    traceMonitorBeginGroupPut,
+    traceMonitorEndGroupPut,
+    traceMonitorPoll,
+    traceMonitorRelease,
+    traceMonitorReleaseActive,
+    traceChannelProcess,
+    traceChannelGet,
+    traceChannelPut,
+    traceChannelPutGet,
+    traceChannelGetArray,
+    traceChannelPutArray,
+    traceChannelSetLength
+};
+
+/**
+ * @brief One event in the trace ring.
+ */
+struct epicsShareClass PVRecordTraceEvent
+{
+    /** epicsMonotonicGet() at the time of the event, in nanoseconds. */
+    epicsUInt64 time;
+    /** PVRecord::getTraceId of the record. */
+    std::size_t recordId;
+    /** A PVRecordTraceOp. */
+    epicsUInt32 op;
+    /** The field offset in the record or 0. */
+    epicsUInt32 fieldOffset;
+    /** The name of the thread that recorded the event. Set by getEvents. */
+    std::string threadName;
+};
+
+/**
+ * @brief A binary trace of record activity.
+ *
+ * Each thread writes to its own fixed size ring.
+ * Writing an event takes no lock and does no allocation
+ * except the first time a thread writes an event.
+ * When a ring is full the oldest events are overwritten.
+ * The ring of an EPICS thread that exits is reused by the next thread
+ * that writes an event. Other threads, for example pvAccess client
+ * threads, can not give their ring back, so at most 64 rings are
+ * created and then a new thread takes over the ring that was taken
+ * longest ago. Its events from then on have the name of the new thread.
+ * Events are selected by PVRecord::getTraceId, which is not reused
+ * when a record is destroyed.
+ * MonitorLocal and the channel operations of ChannelLocal write events
+ * for records with a trace level greater than 1.
+ * The lock and group put methods of PVRecord write events
+ * for records with a trace level greater than 2.
+ */
+class epicsShareClass PVRecordTrace
+{
+public:
+    /**
+     * @brief Write an event to the ring of the calling thread.
+     * @param pvRecord The record.
+     * @param op The PVRecordTraceOp.
+     * @param fieldOffset The field offset or 0.
+     */
+    static void record(
+        const PVRecord * pvRecord,
+        PVRecordTraceOp op,
+        std::size_t fieldOffset = 0);
+    /**
+     * @brief Get the events of a record from the rings of all threads.
+     *
+     * This can be called while other threads are writing events.
+     * An event that is overwritten while it is read is left out.
+     * @param pvRecord The record.
+     * @param events The events are appended, sorted by time.
+     */
+    static void getEvents(
+        const PVRecord * pvRecord,
+        std::vector<PVRecordTraceEvent> & events);
+    /**
+     * @brief Get the name of an operation.
+     * @param op The PVRecordTraceOp.
+     * @return The name.
+     */
+    static const char * getOpName(epicsUInt32 op);
+};
+
+}}
+
+#endif  /* PVRECORDTRACE_H */
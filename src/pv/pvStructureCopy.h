@@ -139,6 +139,20 @@ public:
     bool updateCopySetBitSet(
         epics::pvData::PVStructurePtr const  &copyPVStructure,
         epics::pvData::BitSetPtr const  &bitSet);
+    /**
+     * Like updateCopySetBitSet but the values are taken from pvSnapshot
+     * instead of pvMaster.
+     * pvSnapshot must have the same introspection interface as pvMaster.
+     * Must only be called if hasFilters is false.
+     * @param copyPVStructure A copy top-level structure.
+     * @param bitSet A bitSet for copyPVStructure.
+     * @param pvSnapshot A copy of pvMaster.
+     * @returns (false,true) if client (should not,should) receive changes.
+     */
+    bool updateCopySetBitSet(
+        epics::pvData::PVStructurePtr const  &copyPVStructure,
+        epics::pvData::BitSetPtr const  &bitSet,
+        epics::pvData::PVStructurePtr const  &pvSnapshot);
     /**
      * For each set bit in bitSet
      * set the field in copyPVStructure to the value of the corresponding field in pvMaster.
@@ -171,6 +185,10 @@ public:
      * Is master field requested?
      */
     bool isMasterFieldRequested() const {return requestHasMasterField;}
+    /**
+     * Does the request have plugins that filter the data?
+     */
+    bool hasFilters() const {return requestHasFilters;}
     /**
      * For debugging.
      */
@@ -188,6 +206,7 @@ private:
     epics::pvData::PVStructurePtr cacheInitStructure;
     epics::pvData::BitSetPtr ignorechangeBitSet;
     bool requestHasMasterField;
+    bool requestHasFilters;
 
     void traverseMaster(
         CopyNodePtr const &node,
@@ -200,6 +219,11 @@ private:
         epics::pvData::PVFieldPtr const &pvCopy,
         CopyNodePtr const &node,
         epics::pvData::BitSetPtr const &bitSet);
+    void updateCopySetBitSet(
+        epics::pvData::PVFieldPtr const &pvCopy,
+        CopyNodePtr const &node,
+        epics::pvData::PVStructurePtr const &pvSnapshot,
+        epics::pvData::BitSetPtr const &bitSet);
     void updateCopyFromBitSet(
         epics::pvData::PVFieldPtr const &pvCopy,
         CopyNodePtr const &node,
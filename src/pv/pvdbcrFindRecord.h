@@ -0,0 +1,75 @@
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+#ifndef PVDBCRFINDRECORD_H
+#define PVDBCRFINDRECORD_H
+
+#include <pv/pvDatabase.h>
+#include <pv/pvSupport.h>
+#include <pv/pvStructureCopy.h>
+#include <pv/rpcService.h>
+
+#include <shareLib.h>
+
+namespace epics { namespace pvDatabase {
+
+class PvdbcrFindRecord;
+typedef std::tr1::shared_ptr<PvdbcrFindRecord> PvdbcrFindRecordPtr;
+
+/**
+ * @brief  PvdbcrFindRecord A record that finds the records whose names match a pattern.
+ *
+ * process puts the names that match argument.pattern into result.names.
+ * See PVDatabase::findRecords.
+ * The same is available as a channelRPC request with a string field
+ * pattern at the top level of the request.
+ */
+class epicsShareClass PvdbcrFindRecord :
+     public PVRecord
+{
+private:
+    PvdbcrFindRecord(
+        std::string const & recordName,epics::pvData::PVStructurePtr const & pvStructure,
+        int asLevel,std::string const & asGroup);
+    epics::pvData::PVStringPtr pvPattern;
+    epics::pvData::PVStringArrayPtr pvNames;
+public:
+    POINTER_DEFINITIONS(PvdbcrFindRecord);
+    /**
+     * The Destructor.
+     */
+    virtual ~PvdbcrFindRecord() {}
+    /**
+     * @brief Create a record.
+     *
+     * @param recordName The record name.
+     * @param asLevel  The access security level.
+     * @param asGroup  The access security group.
+     * @return The PVRecord
+     */
+     static PvdbcrFindRecordPtr create(
+        std::string const & recordName,
+        int asLevel=0,std::string const & asGroup = std::string("DEFAULT"));
+    /**
+     *  @brief a PVRecord method
+     * @return success or failure
+     */
+    virtual bool init();
+    /**
+     *  @brief process method that finds the records.
+     */
+    virtual void process();
+    /**
+     * @brief The channelRPC service.
+     * @param pvRequest The pvRequest.
+     * @return The service.
+     */
+    virtual epics::pvAccess::RPCServiceAsync::shared_pointer getService(
+        epics::pvData::PVStructurePtr const & pvRequest);
+};
+
+}}
+
+#endif  /* PVDBCRFINDRECORD_H */
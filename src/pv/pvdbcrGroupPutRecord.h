@@ -0,0 +1,98 @@
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+#ifndef PVDBCRGROUPPUTRECORD_H
+#define PVDBCRGROUPPUTRECORD_H
+
+#include <pv/pvDatabase.h>
+#include <pv/pvSupport.h>
+#include <pv/pvStructureCopy.h>
+#include <pv/rpcService.h>
+
+#include <shareLib.h>
+
+namespace epics { namespace pvDatabase {
+
+class PvdbcrGroupPutRecord;
+typedef std::tr1::shared_ptr<PvdbcrGroupPutRecord> PvdbcrGroupPutRecordPtr;
+
+/**
+ * @brief  PvdbcrGroupPutRecord A record that puts to fields of several records as a unit.
+ *
+ * Element i of the string arrays recordName, fieldName and value
+ * specify one put. All the records are locked with a PVRecordLockSet,
+ * all puts are done in one group put and
+ * the listeners of all the records are notified before any record is unlocked.
+ * If any record or field is not found or any value can not be converted
+ * nothing is put.
+ * The group put is done by a channelRPC request with the same three
+ * fields at the top level of the request. A put/process of the record
+ * only sets result.status, see process.
+ */
+class epicsShareClass PvdbcrGroupPutRecord :
+     public PVRecord
+{
+private:
+    PvdbcrGroupPutRecord(
+        std::string const & recordName,epics::pvData::PVStructurePtr const & pvStructure,
+        int asLevel,std::string const & asGroup);
+    epics::pvData::PVStringArrayPtr pvRecordNames;
+    epics::pvData::PVStringArrayPtr pvFieldNames;
+    epics::pvData::PVStringArrayPtr pvValues;
+    epics::pvData::PVStringPtr pvResult;
+public:
+    POINTER_DEFINITIONS(PvdbcrGroupPutRecord);
+    /**
+     * The Destructor.
+     */
+    virtual ~PvdbcrGroupPutRecord() {}
+    /**
+     * @brief Create a record.
+     *
+     * @param recordName The record name.
+     * @param asLevel  The access security level.
+     * @param asGroup  The access security group.
+     * @return The PVRecord
+     */
+     static PvdbcrGroupPutRecordPtr create(
+        std::string const & recordName,
+        int asLevel=0,std::string const & asGroup = std::string("DEFAULT"));
+    /**
+     * @brief Put to the fields of the records.
+     *
+     * @param recordNames The record names.
+     * @param fieldNames The field names.
+     * @param values The values.
+     * @return "success" or the reason nothing was put.
+     */
+    static std::string groupPut(
+        epics::pvData::PVStringArray::const_svector const & recordNames,
+        epics::pvData::PVStringArray::const_svector const & fieldNames,
+        epics::pvData::PVStringArray::const_svector const & values);
+    /**
+     *  @brief a PVRecord method
+     * @return success or failure
+     */
+    virtual bool init();
+    /**
+     *  @brief process method that does the group put.
+     *
+     * It does not put to the other records, since the caller holds the
+     * lock of this record and the records of a PVRecordLockSet must be
+     * locked in order. result.status says to use a channelRPC request.
+     */
+    virtual void process();
+    /**
+     * @brief The channelRPC service.
+     * @param pvRequest The pvRequest.
+     * @return The service.
+     */
+    virtual epics::pvAccess::RPCServiceAsync::shared_pointer getService(
+        epics::pvData::PVStructurePtr const & pvRequest);
+};
+
+}}
+
+#endif  /* PVDBCRGROUPPUTRECORD_H */
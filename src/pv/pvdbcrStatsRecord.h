@@ -0,0 +1,65 @@
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+#ifndef PVDBCRSTATSRECORD_H
+#define PVDBCRSTATSRECORD_H
+
+#include <pv/pvDatabase.h>
+#include <pv/pvSupport.h>
+#include <pv/pvStructureCopy.h>
+
+#include <shareLib.h>
+
+namespace epics { namespace pvDatabase {
+
+class PvdbcrStatsRecord;
+typedef std::tr1::shared_ptr<PvdbcrStatsRecord> PvdbcrStatsRecordPtr;
+
+/**
+ * @brief  PvdbcrStatsRecord A record that gets the statistics of a record in the master database.
+ *
+ * The result has one field for each member of PVRecordStats.
+ */
+class epicsShareClass PvdbcrStatsRecord :
+     public PVRecord
+{
+private:
+  PvdbcrStatsRecord(
+    std::string const & recordName,epics::pvData::PVStructurePtr const & pvStructure,
+    int asLevel,std::string const & asGroup);
+    epics::pvData::PVStringPtr pvRecordName;
+    epics::pvData::PVStringPtr pvResult;
+    epics::pvData::PVStructurePtr pvStats;
+public:
+    POINTER_DEFINITIONS(PvdbcrStatsRecord);
+    /**
+     * The Destructor.
+     */
+    virtual ~PvdbcrStatsRecord() {}
+    /**
+     * @brief Create a record.
+     *
+     * @param recordName The record name.
+     * @param asLevel  The access security level.
+     * @param asGroup  The access security group.
+     * @return The PVRecord
+     */
+     static PvdbcrStatsRecordPtr create(
+        std::string const & recordName,
+        int asLevel=0,std::string const & asGroup = std::string("DEFAULT"));
+    /**
+     *  @brief a PVRecord method
+     * @return success or failure
+     */
+    virtual bool init();
+    /**
+     *  @brief process method that gets the statistics of a record.
+     */
+    virtual void process();
+};
+
+}}
+
+#endif  /* PVDBCRSTATSRECORD_H */
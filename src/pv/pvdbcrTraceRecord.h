@@ -24,6 +24,9 @@ typedef std::tr1::shared_ptr<PvdbcrTraceRecord> PvdbcrTraceRecordPtr;
 /**
  * @brief  PvdbcrTraceRecord A record sets trace level for a record in the master database.
  *
+ * If argument.dump is true the trace level is not changed.
+ * Instead result.trace is set to the events for the record
+ * that are in the binary trace ring, see PVRecordTrace.
  */
 class epicsShareClass PvdbcrTraceRecord :
      public PVRecord
@@ -34,7 +37,10 @@ private:
     int asLevel,std::string const & asGroup);
     epics::pvData::PVStringPtr pvRecordName;
     epics::pvData::PVIntPtr pvLevel;
+    epics::pvData::PVBooleanPtr pvDump;
     epics::pvData::PVStringPtr pvResult;
+    epics::pvData::PVStringArrayPtr pvTrace;
+    void dumpTrace(PVRecordPtr const & pvRecord);
 public:
     POINTER_DEFINITIONS(PvdbcrTraceRecord);
     /**
@@ -30,6 +30,7 @@
 #define epicsExportSharedSymbols
 #include "pv/pvStructureCopy.h"
 #include "pv/pvDatabase.h"
+#include "pv/pvRecordTrace.h"
 #include "pv/channelProviderLocal.h"
 
 using namespace epics::pvData;
@@ -186,16 +187,12 @@ void ChannelProcessLocal::process()
     if(!requester) return;
     PVRecordPtr pvr(pvRecord.lock());
     if(!pvr) throw std::logic_error("pvRecord is deleted");
-    if(pvr->getTraceLevel()>1)
-    {
-        cout << "ChannelProcessLocal::process";
-        cout << " nProcess " << nProcess << endl;
-    }
+    if(pvr->getTraceLevel()>1) PVRecordTrace::record(pvr.get(),traceChannelProcess);
     try {
         for(int i=0; i< nProcess; i++) {
             epicsGuard <PVRecord> guard(*pvr);
             pvr->beginGroupPut();
-            pvr->process();
+            pvr->timedProcess();
             pvr->endGroupPut();
         }
         requester->processDone(Status::Ok,getPtrSelf());
@@ -341,14 +338,22 @@ void ChannelGetLocal::get()
     try {
         bool notifyClient = true;
         bitSet->clear();
-        {
+        if(callProcess) {
             epicsGuard <PVRecord> guard(*pvr);
-            if(callProcess) {
-                pvr->beginGroupPut();
-                pvr->process();
-                pvr->endGroupPut();
-            }
+            pvr->beginGroupPut();
+            pvr->timedProcess();
+            pvr->endGroupPut();
             notifyClient = pvCopy->updateCopySetBitSet(pvStructure, bitSet);
+        } else {
+            PVRecordSnapshotPtr snapshot;
+            if(!pvCopy->hasFilters()) snapshot = pvr->getSnapshot();
+            if(snapshot) {
+                notifyClient = pvCopy->updateCopySetBitSet(
+                    pvStructure, bitSet, snapshot->getPVStructure());
+            } else {
+                PVRecordSharedGuard guard(*pvr);
+                notifyClient = pvCopy->updateCopySetBitSet(pvStructure, bitSet);
+            }
         }
         if(firstTime) {
             bitSet->clear();
@@ -371,10 +376,7 @@ void ChannelGetLocal::get()
                 pvStructure,
                 temp);
         }
-        if(pvr->getTraceLevel()>1)
-        {
-            cout << "ChannelGetLocal::get" << endl;
-        }
+        if(pvr->getTraceLevel()>1) PVRecordTrace::record(pvr.get(),traceChannelGet);
     } catch(std::exception& ex) {
         Status status = Status(Status::STATUSTYPE_FATAL, ex.what());
         requester->getDone(status,getPtrSelf(),pvStructure,bitSet);
@@ -517,10 +519,7 @@ void ChannelPutLocal::get()
          }
          requester->getDone(
             Status::Ok,getPtrSelf(),pvStructure,bitSet);
-         if(pvr->getTraceLevel()>1)
-         {
-             cout << "ChannelPutLocal::get" << endl;
-         }
+         if(pvr->getTraceLevel()>1) PVRecordTrace::record(pvr.get(),traceChannelGet);
     } catch(std::exception& ex) {
         Status status = Status(Status::STATUSTYPE_FATAL, ex.what());
         PVStructurePtr pvStructure;
@@ -550,15 +549,12 @@ void ChannelPutLocal::put(
             pvr->beginGroupPut();
             pvCopy->updateMaster(pvStructure, bitSet);
             if(callProcess) {
-                 pvr->process();
+                 pvr->timedProcess();
             }
             pvr->endGroupPut();
         }
         requester->putDone(Status::Ok,getPtrSelf());
-        if(pvr->getTraceLevel()>1)
-        {
-            cout << "ChannelPutLocal::put" << endl;
-        }
+        if(pvr->getTraceLevel()>1) PVRecordTrace::record(pvr.get(),traceChannelPut);
     } catch(std::exception& ex) {
         Status status = Status(Status::STATUSTYPE_FATAL, ex.what());
         requester->putDone(status,getPtrSelf());
@@ -716,17 +712,14 @@ void ChannelPutGetLocal::putGet(
             epicsGuard <PVRecord> guard(*pvr);
             pvr->beginGroupPut();
             pvPutCopy->updateMaster(pvPutStructure, putBitSet);
-            if(callProcess) pvr->process();
+            if(callProcess) pvr->timedProcess();
             getBitSet->clear();
             pvGetCopy->updateCopySetBitSet(pvGetStructure, getBitSet);
             pvr->endGroupPut();
         }
         requester->putGetDone(
             Status::Ok,getPtrSelf(),pvGetStructure,getBitSet);
-        if(pvr->getTraceLevel()>1)
-        {
-            cout << "ChannelPutGetLocal::putGet" << endl;
-        }
+        if(pvr->getTraceLevel()>1) PVRecordTrace::record(pvr.get(),traceChannelPutGet);
     } catch(std::exception& ex) {
         Status status = Status(Status::STATUSTYPE_FATAL, ex.what());
         requester->putGetDone(status,getPtrSelf(),pvGetStructure,getBitSet);
@@ -755,10 +748,7 @@ void ChannelPutGetLocal::getPut()
         }
         requester->getPutDone(
             Status::Ok,getPtrSelf(),pvPutStructure,putBitSet);
-        if(pvr->getTraceLevel()>1)
-        {
-            cout << "ChannelPutGetLocal::getPut" << endl;
-        }
+        if(pvr->getTraceLevel()>1) PVRecordTrace::record(pvr.get(),traceChannelGet);
     } catch(std::exception& ex) {
         Status status = Status(Status::STATUSTYPE_FATAL, ex.what());
         PVStructurePtr pvPutStructure;
@@ -788,10 +778,7 @@ void ChannelPutGetLocal::getGet()
          }
          requester->getGetDone(
              Status::Ok,getPtrSelf(),pvGetStructure,getBitSet);
-         if(pvr->getTraceLevel()>1)
-         {
-             cout << "ChannelPutGetLocal::getGet" << endl;
-         }
+         if(pvr->getTraceLevel()>1) PVRecordTrace::record(pvr.get(),traceChannelGet);
     } catch(std::exception& ex) {
         Status status = Status(Status::STATUSTYPE_FATAL, ex.what());
         PVStructurePtr pvPutStructure;
@@ -1157,14 +1144,11 @@ void ChannelArrayLocal::getArray(size_t offset, size_t count, size_t stride)
     if(!requester) return;
     PVRecordPtr pvr(pvRecord.lock());
     if(!pvr) throw std::logic_error("pvRecord is deleted");
-    if(pvr->getTraceLevel()>1)
-    {
-       cout << "ChannelArrayLocal::getArray" << endl;
-    }
+    if(pvr->getTraceLevel()>1) PVRecordTrace::record(pvr.get(),traceChannelGetArray);
     const char *exceptionMessage = NULL;
     try {
         bool ok = false;
-        epicsGuard <PVRecord> guard(*pvr);
+        PVRecordSharedGuard guard(*pvr);
         while(true) {
             size_t length  = pvArray->getLength();
             if(length<=0) break;
@@ -1199,10 +1183,7 @@ void ChannelArrayLocal::putArray(
     if(!requester) return;
     PVRecordPtr pvr(pvRecord.lock());
     if(!pvr) throw std::logic_error("pvRecord is deleted");
-    if(pvr->getTraceLevel()>1)
-    {
-       cout << "ChannelArrayLocal::putArray" << endl;
-    }
+    if(pvr->getTraceLevel()>1) PVRecordTrace::record(pvr.get(),traceChannelPutArray);
     size_t newLength = offset + count*stride;
     if(newLength<pvArray->getLength()) pvArray->setLength(newLength);
     const char *exceptionMessage = NULL;
@@ -1228,7 +1209,7 @@ void ChannelArrayLocal::getLength()
     size_t length = 0;
     const char *exceptionMessage = NULL;
     try {
-        epicsGuard <PVRecord> guard(*pvr);
+        PVRecordSharedGuard guard(*pvr);
         length = pvArray->getLength();
     } catch(std::exception& e) {
         exceptionMessage = e.what();
@@ -1246,10 +1227,7 @@ void ChannelArrayLocal::setLength(size_t length)
     if(!requester) return;
     PVRecordPtr pvr(pvRecord.lock());
     if(!pvr) throw std::logic_error("pvRecord is deleted");
-    if(pvr->getTraceLevel()>1)
-    {
-       cout << "ChannelArrayLocal::setLength" << endl;
-    }
+    if(pvr->getTraceLevel()>1) PVRecordTrace::record(pvr.get(),traceChannelSetLength);
     try {
          {
              epicsGuard <PVRecord> guard(*pvr);
@@ -134,9 +134,22 @@ ChannelFind::shared_pointer ChannelProviderLocal::channelList(
     }
     PVDatabasePtr pvdb(pvDatabase.lock());
     if(!pvdb)throw std::logic_error("pvDatabase was deleted");
-    PVStringArrayPtr records(pvdb->getRecordNames());
     channelListRequester->channelListResult(
-        Status::Ok, shared_from_this(), records->view(), false);
+        Status::Ok, shared_from_this(), pvdb->getRecordNameList(), false);
+    return shared_from_this();
+}
+
+ChannelFind::shared_pointer ChannelProviderLocal::channelList(
+    ChannelListRequester::shared_pointer const & channelListRequester,
+    string const & pattern)
+{
+    if(traceLevel>1) {
+        cout << "ChannelProviderLocal::channelList " << pattern << endl;
+    }
+    PVDatabasePtr pvdb(pvDatabase.lock());
+    if(!pvdb)throw std::logic_error("pvDatabase was deleted");
+    channelListRequester->channelListResult(
+        Status::Ok, shared_from_this(), pvdb->findRecords(pattern), false);
     return shared_from_this();
 }
 
@@ -9,10 +9,17 @@
  * @date 2013.04
  */
 
+#include <algorithm>
 #include <sstream>
+#include <map>
 
 #include <epicsGuard.h>
+#include <epicsAtomic.h>
+#include <epicsThread.h>
+#include <epicsThreadPool.h>
+#include <epicsTime.h>
 #include <pv/thread.h>
+#include <pv/timer.h>
 #include <pv/bitSetUtil.h>
 #include <pv/pvData.h>
 #include <pv/pvAccess.h>
@@ -24,6 +31,7 @@
 #define epicsExportSharedSymbols
 #include "pv/pvStructureCopy.h"
 #include "pv/pvDatabase.h"
+#include "pv/pvRecordTrace.h"
 #include "pv/channelProviderLocal.h"
 
 using namespace epics::pvData;
@@ -47,98 +55,540 @@ static Status alreadyStartedStatus(Status::STATUSTYPE_ERROR,"already started");
 static Status notStartedStatus(Status::STATUSTYPE_ERROR,"not started");
 static Status deletedStatus(Status::STATUSTYPE_ERROR,"record is deleted");
 
+// keeps the counters of the two sides of MonitorElementQueue apart
+static const size_t cacheLineSize = 64;
+
+// an adaptive monitor queue is only shrunk after this many updates,
+// and a MonitorShare only gives back elements after this many updates
+static const size_t queueShrinkUpdates = 100;
+
+// the most free elements a MonitorElementPool keeps for one Structure
+static const size_t poolFreeLimit = 64;
+
+class MonitorElementPool;
+typedef std::tr1::shared_ptr<MonitorElementPool> MonitorElementPoolPtr;
+typedef std::tr1::weak_ptr<MonitorElementPool> MonitorElementPoolWPtr;
+
+// The monitor elements for copies of one Structure.
+// Monitors take elements when they need them and give them back
+// when they stop or are destroyed, so the next monitor with
+// the same Structure does not have to create them.
+// Filtered monitors take the elements of their queue from the pool,
+// monitors with a MonitorShare take them through the share,
+// and each monitor takes the element it merges shared elements into.
+// At most poolFreeLimit elements are kept, others given back are dropped.
+// The data of an element from the pool is not cleared.
+class MonitorElementPool
+{
+public:
+    POINTER_DEFINITIONS(MonitorElementPool);
+    explicit MonitorElementPool(StructureConstPtr const & structure)
+    : structure(structure)
+    {}
+    ~MonitorElementPool();
+    static MonitorElementPoolPtr getPool(StructureConstPtr const & structure);
+    MonitorElementPtr get();
+    void put(MonitorElementPtr const & element);
+private:
+    StructureConstPtr structure;
+    Mutex mutex;
+    MonitorElementPtrArray freeElements;
+};
+
+typedef std::map<const Structure *,MonitorElementPoolWPtr> MonitorElementPoolMap;
+
+struct MonitorElementPools {
+    Mutex mutex;
+    MonitorElementPoolMap poolMap;
+};
+
+static MonitorElementPools * monitorElementPools = 0;
+static epicsThreadOnceId monitorElementPoolsOnce = EPICS_THREAD_ONCE_INIT;
+
+static void createMonitorElementPools(void *)
+{
+    monitorElementPools = new MonitorElementPools();
+}
+
+static MonitorElementPools & getMonitorElementPools()
+{
+    epicsThreadOnce(&monitorElementPoolsOnce,createMonitorElementPools,0);
+    return *monitorElementPools;
+}
+
+MonitorElementPool::~MonitorElementPool()
+{
+    MonitorElementPools & pools = getMonitorElementPools();
+    Lock xx(pools.mutex);
+    MonitorElementPoolMap::iterator iter = pools.poolMap.find(structure.get());
+    if(iter!=pools.poolMap.end() && iter->second.expired()) {
+        pools.poolMap.erase(iter);
+    }
+}
+
+MonitorElementPoolPtr MonitorElementPool::getPool(StructureConstPtr const & structure)
+{
+    MonitorElementPools & pools = getMonitorElementPools();
+    Lock xx(pools.mutex);
+    MonitorElementPoolMap::iterator iter = pools.poolMap.find(structure.get());
+    if(iter!=pools.poolMap.end()) {
+        MonitorElementPoolPtr pool(iter->second.lock());
+        if(pool) return pool;
+    }
+    MonitorElementPoolPtr pool(new MonitorElementPool(structure));
+    pools.poolMap[structure.get()] = pool;
+    return pool;
+}
+
+// An element given back may still be held by a client that polled it
+// before the monitor stopped, so only elements held by nobody else are taken.
+MonitorElementPtr MonitorElementPool::get()
+{
+    {
+        Lock xx(mutex);
+        for(size_t i=freeElements.size(); i>0; --i) {
+            MonitorElementPtr const & element = freeElements[i-1];
+            if(element.use_count()!=1 || element->pvStructurePtr.use_count()!=1) continue;
+            MonitorElementPtr result(element);
+            freeElements.erase(freeElements.begin()+(i-1));
+            return result;
+        }
+    }
+    return MonitorElementPtr(new MonitorElement(
+        getPVDataCreate()->createPVStructure(structure)));
+}
+
+void MonitorElementPool::put(MonitorElementPtr const & element)
+{
+    Lock xx(mutex);
+    if(freeElements.size()>=poolFreeLimit) return;
+    freeElements.push_back(element);
+}
+
 class MonitorElementQueue;
 typedef std::tr1::shared_ptr<MonitorElementQueue> MonitorElementQueuePtr;
 
+// A single producer, single consumer queue of monitor elements.
+// The producer, which holds the record lock, calls getFree and setUsed,
+// or put if the queue has no pool.
+// The consumer calls getUsed (poll) and releaseUsed (release)
+// with MonitorLocal::pollMutex held, which is only shared with clear.
+// The used elements are in one ring and, if the queue has a pool,
+// the released elements are in a second ring for getFree to reuse.
+// getFree takes elements from the pool until the queue has limit elements.
+// The rings have room for size elements, the largest limit.
+// Each side writes only its own counters, so no lock is needed.
+// The counters only increase, the slot of a counter is counter%size.
+// The counters written by each side are on their own cache line.
 class  MonitorElementQueue
 {
 private:
+    MonitorElementPtrArray usedElements;
+    MonitorElementPtrArray freeElements;
+    size_t size;
+    // the elements taken from pool, written by the producer
+    MonitorElementPoolPtr pool;
     MonitorElementPtrArray elements;
-    // TODO use size_t instead
-    int size;
-    int numberFree;
-    int numberUsed;
-    int nextGetFree;
-    int nextSetUsed;
-    int nextGetUsed;
-    int nextReleaseUsed;
+    char padBefore[cacheLineSize];
+    // written by the producer
+    size_t nextGetFree;
+    size_t nextSetUsed;
+    size_t numberOverflow;
+    size_t limit;
+    char padProducer[cacheLineSize];
+    // written by the consumer
+    size_t nextGetUsed;
+    size_t nextReleaseUsed;
+    size_t nextPutFree;
+    size_t overflowsTaken;
+    char padConsumer[cacheLineSize];
 public:
     POINTER_DEFINITIONS(MonitorElementQueue);
 
-    MonitorElementQueue(std::vector<MonitorElementPtr> monitorElementArray)
-    :  elements(monitorElementArray),
-       size(monitorElementArray.size()),
-       numberFree(size),
-       numberUsed(0),
+    MonitorElementQueue(size_t size,MonitorElementPoolPtr const & pool)
+    :  usedElements(size),
+       freeElements(pool ? size : 0),
+       size(size),
+       pool(pool),
        nextGetFree(0),
        nextSetUsed(0),
+       numberOverflow(0),
+       limit(size),
        nextGetUsed(0),
-       nextReleaseUsed(0)
+       nextReleaseUsed(0),
+       nextPutFree(0),
+       overflowsTaken(0)
     {
+        elements.reserve(pool ? size : 0);
     }
 
-    virtual ~MonitorElementQueue() {}
+    virtual ~MonitorElementQueue()
+    {
+        returnElements();
+    }
 
+    // Only while neither side uses the queue: the producer is kept out
+    // by the record lock and the consumer by MonitorLocal::pollMutex.
+    // The elements are given back to the pool.
     void clear()
     {
-        numberFree = size;
-        numberUsed = 0;
-        nextGetFree = 0;
-        nextSetUsed = 0;
-        nextGetUsed = 0;
-        nextReleaseUsed = 0;
+        returnElements();
+        epicsAtomicSetSizeT(&nextGetFree,0);
+        epicsAtomicSetSizeT(&nextSetUsed,0);
+        epicsAtomicSetSizeT(&numberOverflow,0);
+        epicsAtomicSetSizeT(&nextGetUsed,0);
+        epicsAtomicSetSizeT(&nextReleaseUsed,0);
+        epicsAtomicSetSizeT(&nextPutFree,0);
+        overflowsTaken = 0;
     }
 
     MonitorElementPtr getFree()
     {
-        if(numberFree==0) return MonitorElementPtr();
-        numberFree--;
-        int ind = nextGetFree;
-        MonitorElementPtr queueElement = elements[nextGetFree++];
-        if(nextGetFree>=size) nextGetFree = 0;
-        return elements[ind];
+        while(nextGetFree!=epicsAtomicGetSizeT(&nextPutFree)) {
+            MonitorElementPtr element;
+            element.swap(freeElements[nextGetFree % size]);
+            ++nextGetFree;
+            if(elements.size()<=limit) return element;
+            // the limit was lowered, so the element goes back to the pool
+            elements.erase(std::find(elements.begin(),elements.end(),element));
+            pool->put(element);
+        }
+        if(elements.size()>=limit) return MonitorElementPtr();
+        MonitorElementPtr element(pool->get());
+        elements.push_back(element);
+        return element;
     }
 
+    // There is always room, since the queue has at most size elements.
     void setUsed(MonitorElementPtr const &element)
     {
-       if(element!=elements[nextSetUsed++]) {
-           throw std::logic_error("not correct queueElement");
-        }
-        numberUsed++;
-        if(nextSetUsed>=size) nextSetUsed = 0;
+        usedElements[nextSetUsed % size] = element;
+        // publishes the element to the consumer
+        epicsAtomicSetSizeT(&nextSetUsed,nextSetUsed+1);
+    }
+
+    // Called by the producer of a queue without a pool.
+    // Returns false if the queue is full.
+    bool put(MonitorElementPtr const &element)
+    {
+        if(getNumberQueued()>=limit) return false;
+        setUsed(element);
+        return true;
     }
 
     MonitorElementPtr getUsed()
     {
-        if(numberUsed==0) return MonitorElementPtr();
-        int ind = nextGetUsed;
-        MonitorElementPtr queueElement = elements[nextGetUsed++];
-        if(nextGetUsed>=size) nextGetUsed = 0;
-        return elements[ind];
+        if(nextGetUsed==epicsAtomicGetSizeT(&nextSetUsed)) return MonitorElementPtr();
+        MonitorElementPtr const & element = usedElements[nextGetUsed % size];
+        epicsAtomicSetSizeT(&nextGetUsed,nextGetUsed+1);
+        return element;
     }
+
     void releaseUsed(MonitorElementPtr const &element)
     {
-        if(element!=elements[nextReleaseUsed++]) {
+        MonitorElementPtr & slot = usedElements[nextReleaseUsed % size];
+        if(element!=slot) {
             throw std::logic_error(
                "not queueElement returned by last call to getUsed");
         }
-        if(nextReleaseUsed>=size) nextReleaseUsed = 0;
-        numberUsed--;
-        numberFree++;
+        if(pool) {
+            freeElements[nextPutFree % size] = element;
+            // returns the element to the producer
+            epicsAtomicSetSizeT(&nextPutFree,nextPutFree+1);
+        }
+        // so an element without a pool can be reused once no consumer holds it
+        slot.reset();
+        epicsAtomicSetSizeT(&nextReleaseUsed,nextReleaseUsed+1);
+    }
+
+    size_t getNumberUsed()
+    {
+        return epicsAtomicGetSizeT(&nextSetUsed) - epicsAtomicGetSizeT(&nextGetUsed);
+    }
+
+    // The elements queued and not yet released, polled or not.
+    size_t getNumberQueued()
+    {
+        return epicsAtomicGetSizeT(&nextSetUsed) - epicsAtomicGetSizeT(&nextReleaseUsed);
+    }
+
+    size_t getSize() const { return size; }
+
+    size_t getLimit()
+    {
+        return epicsAtomicGetSizeT(&limit);
+    }
+
+    // Called by the producer. A lower limit takes effect as the consumer
+    // releases elements, since elements in use can not be taken back.
+    void setLimit(size_t newLimit)
+    {
+        if(newLimit>size) newLimit = size;
+        epicsAtomicSetSizeT(&limit,newLimit);
+    }
+
+    // The number of times the producer found the queue full since clear.
+    size_t getNumberOverflow()
+    {
+        return epicsAtomicGetSizeT(&numberOverflow);
+    }
+
+    // Called by the producer when getFree found no free element.
+    void overflow()
+    {
+        epicsAtomicIncrSizeT(&numberOverflow);
+    }
+
+    // Called by the consumer, the number of overflows since the last call.
+    size_t takeOverflows()
+    {
+        size_t current = epicsAtomicGetSizeT(&numberOverflow);
+        size_t number = current - overflowsTaken;
+        overflowsTaken = current;
+        return number;
+    }
+
+private:
+    void returnElements()
+    {
+        for(size_t i=0; i<usedElements.size(); ++i) usedElements[i].reset();
+        for(size_t i=0; i<freeElements.size(); ++i) freeElements[i].reset();
+        for(size_t i=0; i<elements.size(); ++i) pool->put(elements[i]);
+        elements.clear();
     }
 };
 
 
 typedef std::tr1::shared_ptr<MonitorRequester> MonitorRequesterPtr;
 
+class MonitorDispatchTask;
+typedef std::tr1::shared_ptr<MonitorDispatchTask> MonitorDispatchTaskPtr;
+
+static epicsThreadPool * dispatchPool = 0;
+static epicsThreadOnceId dispatchPoolOnce = EPICS_THREAD_ONCE_INIT;
+
+static void createDispatchPool(void *)
+{
+    epicsThreadPoolConfig config;
+    epicsThreadPoolConfigDefaults(&config);
+    config.workerPriority = epicsThreadPriorityMedium;
+    dispatchPool = epicsThreadPoolCreate(&config);
+}
+
+// Work of a monitor that is done by the dispatch pool
+// for monitors with record._options.dispatch=async.
+// dispatch is never run by two threads at the same time.
+// If scheduleDispatch is called while dispatch runs,
+// dispatch is run again when it returns.
+class MonitorDispatchTask
+{
+public:
+    virtual ~MonitorDispatchTask()
+    {
+        if(job) epicsJobDestroy(job);
+    }
+protected:
+    MonitorDispatchTask()
+    : job(0),
+      isScheduled(false),
+      isAgain(false)
+    {}
+    // self is this task. It is held until dispatch returns.
+    void scheduleDispatch(MonitorDispatchTaskPtr const & self)
+    {
+        {
+            Lock xx(dispatchMutex);
+            if(isScheduled) {
+                isAgain = true;
+                return;
+            }
+            if(!job) {
+                epicsThreadOnce(&dispatchPoolOnce,createDispatchPool,0);
+                if(dispatchPool) job = epicsJobCreate(dispatchPool,runDispatch,this);
+            }
+            if(job) {
+                isScheduled = true;
+                scheduledSelf = self;
+            }
+        }
+        if(!job || epicsJobQueue(job)!=0) {
+            // no pool, so the caller does the work
+            {
+                Lock xx(dispatchMutex);
+                isScheduled = false;
+                scheduledSelf.reset();
+            }
+            dispatch();
+        }
+    }
+    virtual void dispatch() = 0;
+private:
+    static void runDispatch(void * arg,epicsJobMode mode)
+    {
+        if(mode!=epicsJobModeRun) return;
+        MonitorDispatchTask * task = static_cast<MonitorDispatchTask *>(arg);
+        MonitorDispatchTaskPtr self;
+        while(true) {
+            task->dispatch();
+            Lock xx(task->dispatchMutex);
+            if(task->isAgain) {
+                task->isAgain = false;
+                continue;
+            }
+            task->isScheduled = false;
+            // the task may be destroyed when self is
+            self.swap(task->scheduledSelf);
+            break;
+        }
+    }
+    epicsJob * job;
+    Mutex dispatchMutex;
+    bool isScheduled;
+    bool isAgain;
+    MonitorDispatchTaskPtr scheduledSelf;
+};
+
+class MonitorShare;
+typedef std::tr1::shared_ptr<MonitorShare> MonitorSharePtr;
+typedef std::tr1::weak_ptr<MonitorShare> MonitorShareWPtr;
+typedef std::tr1::weak_ptr<MonitorLocal> MonitorLocalWPtr;
+
+static PVField * getField(PVStructurePtr const & pvStructure,size_t offset)
+{
+    if(offset==0) return pvStructure.get();
+    return pvStructure->getSubField(offset).get();
+}
+
+// Is the field at offset, or a structure that holds it, set in bitSet?
+static bool isCovered(
+    PVStructurePtr const & pvStructure,
+    BitSet const & bitSet,
+    size_t offset)
+{
+    for(PVField * pvField = getField(pvStructure,offset); pvField; pvField = pvField->getParent()) {
+        if(bitSet.get(pvField->getFieldOffset())) return true;
+    }
+    return false;
+}
+
+static void setChanged(BitSet & changedBitSet,BitSet * overrunBitSet,size_t offset)
+{
+    bool isSet = changedBitSet.get(offset);
+    changedBitSet.set(offset);
+    if(isSet && overrunBitSet) overrunBitSet->set(offset);
+}
+
+// The offset in master of the field that triggers the master field callback.
+static size_t getFirstLeafOffset(PVRecordPtr const & pvRecord)
+{
+    size_t numberMasterFields = pvRecord->getPVStructure()->getNumberFields();
+    for(size_t offset=0; offset<numberMasterFields; ++offset) {
+        PVFieldPtr pvMasterField = pvRecord->findPVRecordField(offset)->getPVField();
+        if(pvMasterField->getField()->getType()!=structure) return offset;
+    }
+    return string::npos;
+}
+
+// Sets the copy bits for a field posted in master.
+// This gives the same result as the dataPut calls that
+// postParent and postSubField make for each field of pvCopy.
+static void setChangedMaster(
+    PVRecordPtr const & pvRecord,
+    PVCopyPtr const & pvCopy,
+    size_t firstLeafOffset,
+    size_t masterOffset,
+    BitSet & changedBitSet,
+    BitSet * overrunBitSet)
+{
+    PVRecordFieldPtr pvRecordField = pvRecord->findPVRecordField(masterOffset);
+    PVFieldPtr pvField = pvRecordField->getPVField();
+    size_t nextOffset = pvField->getNextFieldOffset();
+    if(pvCopy->isMasterFieldRequested()
+    && masterOffset<=firstLeafOffset && firstLeafOffset<nextOffset) {
+        size_t offset = pvCopy->getCopyOffset(pvRecord->getPVStructure());
+        if(offset!=string::npos) setChanged(changedBitSet,overrunBitSet,offset);
+    }
+    if(pvCopy->getCopyOffset(pvField)!=string::npos) {
+        // this field or a parent is a field of pvCopy
+        PVRecordFieldPtr pvParent = pvRecordField;
+        while(pvParent) {
+            PVFieldPtr pvParentField = pvParent->getPVField();
+            size_t offset = pvCopy->getCopyOffset(pvParentField);
+            if(offset!=string::npos
+            && pvCopy->getMasterPVField(offset).get()==pvParentField.get())
+            {
+                setChanged(changedBitSet,overrunBitSet,
+                    offset + (masterOffset - pvParentField->getFieldOffset()));
+                return;
+            }
+            pvParent = pvParent->getParent();
+        }
+        return;
+    }
+    // subfields of this field may be fields of pvCopy
+    size_t offset = masterOffset + 1;
+    while(offset<nextOffset) {
+        PVFieldPtr pvSubField = pvRecord->findPVRecordField(offset)->getPVField();
+        size_t copyOffset = pvCopy->getCopyOffset(pvSubField);
+        if(copyOffset!=string::npos
+        && pvCopy->getMasterPVField(copyOffset).get()==pvSubField.get())
+        {
+            setChanged(changedBitSet,overrunBitSet,copyOffset);
+            offset = pvSubField->getNextFieldOffset();
+        } else {
+            ++offset;
+        }
+    }
+}
+
+// Merges the bit sets of newer, an element given out by a MonitorShare,
+// into changed and overrun, which hold the merged bit sets of older updates.
+// Fields changed in both are marked as overrun.
+static void mergeSharedBits(
+    BitSet & changed,
+    BitSet & overrun,
+    MonitorElementPtr const & newer)
+{
+    PVStructurePtr const & pvStructure = newer->pvStructurePtr;
+    BitSet const & newerChanged = *newer->changedBitSet;
+    overrun |= *newer->overrunBitSet;
+    for(int32 offset = changed.nextSetBit(0); offset>=0; offset = changed.nextSetBit(offset+1)) {
+        if(isCovered(pvStructure,newerChanged,offset)) overrun.set(offset);
+    }
+    for(int32 offset = newerChanged.nextSetBit(0); offset>=0; offset = newerChanged.nextSetBit(offset+1)) {
+        if(isCovered(pvStructure,changed,offset)) overrun.set(offset);
+    }
+    changed |= newerChanged;
+}
+
+// Makes an element that has the data of newer and the merged bit sets.
+// The data of newer has the newest value of every field,
+// so the data of older elements is not needed.
+static MonitorElementPtr createSharedElement(
+    MonitorElementPtr const & newer,
+    BitSet const & changed,
+    BitSet const & overrun)
+{
+    PVStructurePtr const & pvStructure = newer->pvStructurePtr;
+    MonitorElementPtr merged(new MonitorElement(pvStructure));
+    *merged->changedBitSet = changed;
+    *merged->overrunBitSet = overrun;
+    BitSetUtil::compress(merged->changedBitSet,pvStructure);
+    BitSetUtil::compress(merged->overrunBitSet,pvStructure);
+    return merged;
+}
+
 
 class MonitorLocal :
     public Monitor,
     public PVListener,
+    public MonitorDispatchTask,
     public std::tr1::enable_shared_from_this<MonitorLocal>
 {
     enum MonitorState {idle,active,deleted};
 public:
+    // What happens when the queue is full. See init.
+    enum OverflowPolicy {overflowCoalesce,overflowDropOldest,overflowLatest};
     POINTER_DEFINITIONS(MonitorLocal);
     virtual ~MonitorLocal();
     virtual Status start();
@@ -146,15 +596,19 @@ public:
     virtual MonitorElementPtr poll();
     virtual void detach(PVRecordPtr const & pvRecord){}
     virtual void release(MonitorElementPtr const & monitorElement);
-    virtual void dataPut(PVRecordFieldPtr const & pvRecordField);
-    virtual void dataPut(
-        PVRecordStructurePtr const & requested,
-        PVRecordFieldPtr const & pvRecordField);
-    virtual void beginGroupPut(PVRecordPtr const & pvRecord);
-    virtual void endGroupPut(PVRecordPtr const & pvRecord);
+    virtual void dataPutChangeSet(
+        PVRecordPtr const & pvRecord,
+        BitSetPtr const & changedBitSet);
+    // a monitor without a share is its own listener
+    virtual std::size_t getNumberMonitors() const {return 1;}
     virtual void unlisten(PVRecordPtr const & pvRecord);
     MonitorElementPtr getActiveElement();
     void releaseActiveElement();
+    bool putShared(MonitorElementPtr const & element);
+    void eventQueued();
+    void throttleExpired();
+    virtual void getStats(Stats & stats) const;
+    void getLocalStats(MonitorLocalStats & stats);
     bool init(PVStructurePtr const & pvRequest);
     MonitorLocal(
         MonitorRequester::shared_pointer const & channelMonitorRequester,
@@ -165,26 +619,487 @@ private:
     {
         return shared_from_this();
     }
+    void mergeElement(MonitorElementPtr const & older,MonitorElementPtr const & newer);
+    void mergeSharedElement(MonitorElementPtr const & older,MonitorElementPtr const & newer);
+    bool queueActiveElement();
+    bool queuePending();
+    void queueHeldUpdate();
+    bool isThrottled();
+    void countOverrun(BitSet const & overrunBitSet);
+    bool growQueue();
+    void shrinkQueue();
+    size_t getClientLimit(size_t limit) const;
+    void clearQueue();
+    void notifyRequester();
+    virtual void dispatch();
     MonitorRequester::weak_pointer monitorRequester;
     PVRecordPtr pvRecord;
-    MonitorState state;
+    // a MonitorState, written with mutex held, read with epicsAtomic
+    int state;
     PVCopyPtr pvCopy;
+    OverflowPolicy overflowPolicy;
+    // copy and monitorEvent are done by the dispatch pool
+    bool isAsync;
+    // from record._options.maxRate, 0 if not throttled
+    epicsUInt64 minimumInterval;
+    // epicsMonotonicGet when an update was last queued
+    epicsUInt64 lastQueued;
+    bool isThrottleScheduled;
+    TimerCallbackPtr throttle;
     MonitorElementQueuePtr queue;
+    // The bounds of the queue limit, from record._options.queueSize
+    // and maxQueueSize. They are equal unless the queue is adaptive.
+    size_t minimumLimit;
+    size_t maximumLimit;
+    // the updates queued since the limit was last changed and the most
+    // elements the consumer held meanwhile, written by the producer
+    size_t numberAdaptQueued;
+    size_t maximumLag;
+    // the queued updates with overrun fields and the number of the fields
+    size_t numberOverrun;
+    size_t numberOverrunFields;
     MonitorElementPtr activeElement;
-    bool isGroupPut;
-    bool dataChanged;
+    // Set if the updates come from a MonitorShare.
+    // The queue then holds elements shared with other monitors.
+    MonitorSharePtr share;
+    // The newest update from the share that is not queued, because the
+    // queue was full or the monitor is throttled, and the merged bit sets
+    // of the updates not queued. Owned by the producer.
+    MonitorElementPtr pendingElement;
+    BitSetPtr pendingChangedBitSet;
+    BitSetPtr pendingOverrunBitSet;
+    // Set by the producer while an update is held in activeElement or
+    // pendingElement because the queue was full. Read by release with epicsAtomic.
+    int isUpdateHeld;
+    // The element poll merges shared elements into, owned by the consumer.
+    // It is reused, so poll does not merge while the client holds it.
+    MonitorElementPtr mergedElement;
+    bool isMergedPolled;
+    // offset in master of the field that triggers the master field callback
+    size_t firstLeafOffset;
+    Mutex mutex;
+    // Held by poll and release, and while the queue is cleared,
+    // so a client never polls or releases while start or stop clear it.
+    // Only the consumer side takes it, the producer does not wait for it.
+    Mutex pollMutex;
+};
+
+static Timer * throttleTimer = 0;
+static epicsThreadOnceId throttleTimerOnce = EPICS_THREAD_ONCE_INIT;
+
+static void createThrottleTimer(void *)
+{
+    throttleTimer = new Timer("pvDatabaseMonitorThrottle",middlePriority);
+}
+
+// The timer of all monitors with record._options.maxRate.
+static Timer & getThrottleTimer()
+{
+    epicsThreadOnce(&throttleTimerOnce,createThrottleTimer,0);
+    return *throttleTimer;
+}
+
+// Queues the updates a throttled monitor held back.
+class MonitorThrottle :
+    public TimerCallback
+{
+public:
+    explicit MonitorThrottle(MonitorLocalPtr const & monitor)
+    : monitor(monitor)
+    {}
+    virtual ~MonitorThrottle() {}
+    virtual void callback()
+    {
+        MonitorLocalPtr monitor(this->monitor.lock());
+        if(monitor) monitor->throttleExpired();
+    }
+    virtual void timerStopped() {}
+private:
+    MonitorLocalWPtr monitor;
+};
+
+typedef std::vector<MonitorLocalWPtr> MonitorLocalWPtrArray;
+typedef std::tr1::shared_ptr<const MonitorLocalWPtrArray> MonitorLocalWPtrArrayConstPtr;
+typedef std::pair<const PVRecord *,string> MonitorShareKey;
+
+// The monitors of a record that have the same request, except for
+// record._options, and no filters share one MonitorShare.
+// It copies each update from the record once and gives the same element
+// to the queue of each monitor. The element is not modified until
+// no monitor holds it.
+// All methods are called with the record locked,
+// which also guards the fields of MonitorShare.
+// If the monitors are async the copy is made by dispatch,
+// with the record locked for readers.
+class MonitorShare :
+    public PVListener,
+    public MonitorDispatchTask,
+    public std::tr1::enable_shared_from_this<MonitorShare>
+{
+public:
+    POINTER_DEFINITIONS(MonitorShare);
+    MonitorShare(
+        PVRecordPtr const & pvRecord,
+        PVCopyPtr const & pvCopy,
+        MonitorShareKey const & key,
+        bool isAsync);
+    virtual ~MonitorShare();
+    static MonitorSharePtr getShare(
+        PVRecordPtr const & pvRecord,
+        PVStructurePtr const & pvRequest,
+        PVCopyPtr const & pvCopy,
+        bool isAsync);
+    void start(MonitorLocalPtr const & monitor);
+    void stop(MonitorLocalPtr const & monitor);
+    virtual void detach(PVRecordPtr const & pvRecord){}
+    virtual void dataPutChangeSet(
+        PVRecordPtr const & pvRecord,
+        BitSetPtr const & changedBitSet);
+    virtual std::size_t getNumberMonitors() const;
+    virtual void unlisten(PVRecordPtr const & pvRecord);
+private:
+    MonitorElementPtr getFreeElement();
+    void trimElements();
+    void putFreeElements(size_t keep);
+    void removeMonitor(MonitorLocal * monitor);
+    bool publish();
+    void removeDestroyedMonitors();
+    virtual void dispatch();
+    PVRecordPtr pvRecord;
+    PVCopyPtr pvCopy;
+    MonitorShareKey key;
+    bool isAsync;
+    size_t firstLeafOffset;
+    // kept up to date while there are monitors
+    PVStructurePtr pvCopyStructure;
+    // the changes not yet published
+    BitSetPtr changedBitSet;
+    // the elements given out, reused when no monitor holds it
+    // and given back to pool by trimElements or when the share is destroyed
+    MonitorElementPoolPtr pool;
+    MonitorElementPtrArray elements;
+    size_t nextElement;
+    // the updates since elements was last trimmed
+    // and the most elements in use meanwhile
+    size_t numberTrimUpdates;
+    size_t maximumInUse;
+    bool isListening;
+    // replaced, not modified, so it can be walked while a monitor stops
+    MonitorLocalWPtrArrayConstPtr monitors;
+};
+
+typedef std::map<MonitorShareKey,MonitorShareWPtr> MonitorShareMap;
+
+struct MonitorShares {
     Mutex mutex;
-    Mutex queueMutex;
+    MonitorShareMap shareMap;
 };
 
+static MonitorShares * monitorShares = 0;
+static epicsThreadOnceId monitorSharesOnce = EPICS_THREAD_ONCE_INIT;
+
+static void createMonitorShares(void *)
+{
+    monitorShares = new MonitorShares();
+}
+
+static MonitorShares & getMonitorShares()
+{
+    epicsThreadOnce(&monitorSharesOnce,createMonitorShares,0);
+    return *monitorShares;
+}
+
+// The part of pvRequest that selects the fields of the copy.
+// The record options are options of each monitor.
+static string getShareRequest(PVStructurePtr const & pvRequest)
+{
+    std::ostringstream request;
+    PVFieldPtrArray const & pvFields = pvRequest->getPVFields();
+    for(size_t i=0; i<pvFields.size(); ++i) {
+        if(pvFields[i]->getFieldName()=="record") continue;
+        request << pvFields[i]->getFieldName() << *pvFields[i];
+    }
+    return request.str();
+}
+
+MonitorShare::MonitorShare(
+    PVRecordPtr const & pvRecord,
+    PVCopyPtr const & pvCopy,
+    MonitorShareKey const & key,
+    bool isAsync)
+: pvRecord(pvRecord),
+  pvCopy(pvCopy),
+  key(key),
+  isAsync(isAsync),
+  firstLeafOffset(getFirstLeafOffset(pvRecord)),
+  pvCopyStructure(pvCopy->createPVStructure()),
+  changedBitSet(new BitSet(pvCopyStructure->getNumberFields())),
+  pool(MonitorElementPool::getPool(pvCopy->getStructure())),
+  nextElement(0),
+  numberTrimUpdates(0),
+  maximumInUse(0),
+  isListening(false)
+{
+}
+
+MonitorShare::~MonitorShare()
+{
+    for(size_t i=0; i<elements.size(); ++i) pool->put(elements[i]);
+    MonitorShares & shares = getMonitorShares();
+    Lock xx(shares.mutex);
+    MonitorShareMap::iterator iter = shares.shareMap.find(key);
+    if(iter!=shares.shareMap.end() && iter->second.expired()) {
+        shares.shareMap.erase(iter);
+    }
+}
+
+MonitorSharePtr MonitorShare::getShare(
+    PVRecordPtr const & pvRecord,
+    PVStructurePtr const & pvRequest,
+    PVCopyPtr const & pvCopy,
+    bool isAsync)
+{
+    MonitorShareKey key(pvRecord.get(),
+        string(isAsync ? "async:" : "sync:") + getShareRequest(pvRequest));
+    MonitorShares & shares = getMonitorShares();
+    Lock xx(shares.mutex);
+    MonitorShareMap::iterator iter = shares.shareMap.find(key);
+    if(iter!=shares.shareMap.end()) {
+        MonitorSharePtr share(iter->second.lock());
+        if(share) return share;
+    }
+    MonitorSharePtr share(new MonitorShare(pvRecord,pvCopy,key,isAsync));
+    shares.shareMap[key] = share;
+    return share;
+}
+
+void MonitorShare::start(MonitorLocalPtr const & monitor)
+{
+    removeMonitor(monitor.get());
+    if(!isListening) {
+        isListening = true;
+        pvRecord->addChangeSetListener(shared_from_this());
+        pvCopy->updateCopySetBitSet(pvCopyStructure,changedBitSet);
+        changedBitSet->clear();
+    }
+    std::tr1::shared_ptr<MonitorLocalWPtrArray> newMonitors(
+        monitors ? new MonitorLocalWPtrArray(*monitors) : new MonitorLocalWPtrArray());
+    newMonitors->push_back(monitor);
+    monitors = newMonitors;
+    MonitorElementPtr element = getFreeElement();
+    element->pvStructurePtr->copyUnchecked(*pvCopyStructure);
+    element->changedBitSet->clear();
+    element->changedBitSet->set(0);
+    element->overrunBitSet->clear();
+    if(monitor->putShared(element)) monitor->eventQueued();
+}
+
+void MonitorShare::stop(MonitorLocalPtr const & monitor)
+{
+    removeMonitor(monitor.get());
+    if(monitors) return;
+    if(isListening) {
+        isListening = false;
+        pvRecord->removeChangeSetListener(shared_from_this());
+    }
+    // elements still held by a client stay until the next trim
+    putFreeElements(0);
+}
+
+// Also removes monitors that no longer exist.
+void MonitorShare::removeMonitor(MonitorLocal * monitor)
+{
+    if(!monitors) return;
+    std::tr1::shared_ptr<MonitorLocalWPtrArray> newMonitors(new MonitorLocalWPtrArray());
+    MonitorLocalWPtrArray::const_iterator iter;
+    for(iter = monitors->begin(); iter!=monitors->end(); ++iter) {
+        MonitorLocalPtr other(iter->lock());
+        if(other && other.get()!=monitor) newMonitors->push_back(other);
+    }
+    if(newMonitors->empty()) {
+        monitors.reset();
+    } else {
+        monitors = newMonitors;
+    }
+}
+
+// The data of an element is also held by elements that
+// createSharedElement made from it.
+static bool isFreeElement(MonitorElementPtr const & element)
+{
+    return element.use_count()==1 && element->pvStructurePtr.use_count()==1;
+}
+
+// Looks for a free element starting after the last one given out,
+// since monitors release elements in the order they get them.
+MonitorElementPtr MonitorShare::getFreeElement()
+{
+    size_t number = elements.size();
+    for(size_t i=0; i<number; ++i) {
+        if(++nextElement>=number) nextElement = 0;
+        MonitorElementPtr const & element = elements[nextElement];
+        if(isFreeElement(element)) return element;
+    }
+    MonitorElementPtr element(pool->get());
+    nextElement = elements.size();
+    elements.push_back(element);
+    return element;
+}
+
+void MonitorShare::dataPutChangeSet(
+    PVRecordPtr const & pvRecord,
+    BitSetPtr const & changedMasterBitSet)
+{
+    if(pvRecord->getTraceLevel()>1) {
+        PVRecordTrace::record(pvRecord.get(),traceMonitorDataPut,
+            changedMasterBitSet->nextSetBit(0));
+    }
+    if(!monitors) return;
+    int32 offset = changedMasterBitSet->nextSetBit(0);
+    while(offset>=0) {
+        setChangedMaster(pvRecord,pvCopy,firstLeafOffset,offset,*changedBitSet,0);
+        offset = changedMasterBitSet->nextSetBit(offset+1);
+    }
+    if(isAsync) {
+        scheduleDispatch(shared_from_this());
+        return;
+    }
+    if(!publish()) removeDestroyedMonitors();
+}
+
+// Runs on the dispatch pool without the record lock held.
+void MonitorShare::dispatch()
+{
+    bool hasMonitors = true;
+    {
+        PVRecordSharedGuard guard(*pvRecord);
+        hasMonitors = publish();
+    }
+    if(hasMonitors) return;
+    // changing the listeners needs the record lock
+    epicsGuard<PVRecord> guard(*pvRecord);
+    removeDestroyedMonitors();
+}
+
+// Copies the changes to the monitors.
+// Returns false if all the monitors were destroyed without being stopped.
+bool MonitorShare::publish()
+{
+    MonitorLocalWPtrArrayConstPtr current(monitors);
+    if(!current) return true;
+    if(!pvCopy->updateCopyFromBitSet(pvCopyStructure,changedBitSet)) {
+        changedBitSet->clear();
+        return true;
+    }
+    BitSetUtil::compress(changedBitSet,pvCopyStructure);
+    // arrays are shared, not copied, by copyUnchecked
+    MonitorElementPtr element = getFreeElement();
+    element->pvStructurePtr->copyUnchecked(*pvCopyStructure);
+    *element->changedBitSet = *changedBitSet;
+    element->overrunBitSet->clear();
+    changedBitSet->clear();
+    size_t numberMonitors = 0;
+    MonitorLocalWPtrArray::const_iterator iter;
+    for(iter = current->begin(); iter!=current->end(); ++iter) {
+        MonitorLocalPtr monitor(iter->lock());
+        if(!monitor) continue;
+        if(monitor->putShared(element)) monitor->eventQueued();
+        ++numberMonitors;
+    }
+    trimElements();
+    return numberMonitors>0;
+}
+
+// Called by publish after each update is given to the monitors.
+// Every queueShrinkUpdates updates the free elements beyond
+// one more than the most that were in use meanwhile go back to the pool,
+// so the elements of a burst, or of monitors that stopped, are not kept.
+void MonitorShare::trimElements()
+{
+    size_t numberInUse = 0;
+    for(size_t i=0; i<elements.size(); ++i) {
+        if(!isFreeElement(elements[i])) ++numberInUse;
+    }
+    if(numberInUse>maximumInUse) maximumInUse = numberInUse;
+    if(++numberTrimUpdates<queueShrinkUpdates) return;
+    putFreeElements(maximumInUse + 1);
+    numberTrimUpdates = 0;
+    maximumInUse = 0;
+}
+
+// Gives free elements back to the pool until at most keep are left.
+void MonitorShare::putFreeElements(size_t keep)
+{
+    for(size_t i=elements.size(); i>0 && elements.size()>keep; --i) {
+        if(!isFreeElement(elements[i-1])) continue;
+        pool->put(elements[i-1]);
+        elements.erase(elements.begin()+(i-1));
+    }
+    if(nextElement>=elements.size()) nextElement = 0;
+}
+
+// Called with the record locked, like every change of monitors.
+size_t MonitorShare::getNumberMonitors() const
+{
+    if(!monitors) return 0;
+    size_t number = 0;
+    MonitorLocalWPtrArray::const_iterator iter;
+    for(iter = monitors->begin(); iter!=monitors->end(); ++iter) {
+        if(!iter->expired()) ++number;
+    }
+    return number;
+}
+
+void MonitorShare::removeDestroyedMonitors()
+{
+    removeMonitor(0);
+    if(!monitors && isListening) {
+        isListening = false;
+        pvRecord->removeChangeSetListener(shared_from_this());
+    }
+}
+
+void MonitorShare::unlisten(PVRecordPtr const & pvRecord)
+{
+    MonitorLocalWPtrArrayConstPtr current(monitors);
+    monitors.reset();
+    isListening = false;
+    {
+        MonitorShares & shares = getMonitorShares();
+        Lock xx(shares.mutex);
+        MonitorShareMap::iterator iter = shares.shareMap.find(key);
+        if(iter!=shares.shareMap.end() && iter->second.lock().get()==this) {
+            shares.shareMap.erase(iter);
+        }
+    }
+    if(!current) return;
+    MonitorLocalWPtrArray::const_iterator iter;
+    for(iter = current->begin(); iter!=current->end(); ++iter) {
+        MonitorLocalPtr monitor(iter->lock());
+        if(monitor) monitor->unlisten(pvRecord);
+    }
+}
+
 MonitorLocal::MonitorLocal(
     MonitorRequester::shared_pointer const & channelMonitorRequester,
     PVRecordPtr const &pvRecord)
 : monitorRequester(channelMonitorRequester),
   pvRecord(pvRecord),
   state(idle),
-  isGroupPut(false),
-  dataChanged(false)
+  overflowPolicy(overflowCoalesce),
+  isAsync(false),
+  minimumInterval(0),
+  lastQueued(0),
+  isThrottleScheduled(false),
+  minimumLimit(0),
+  maximumLimit(0),
+  numberAdaptQueued(0),
+  maximumLag(0),
+  numberOverrun(0),
+  numberOverrunFields(0),
+  isUpdateHeld(0),
+  isMergedPolled(false),
+  firstLeafOffset(string::npos)
 {
 }
 
@@ -198,179 +1113,476 @@ Status MonitorLocal::start()
 {
     if(pvRecord->getTraceLevel()>0)
     {
-        cout << "MonitorLocal::start state " << state << endl;
+        cout << "MonitorLocal::start state " << epicsAtomicGetIntT(&state) << endl;
     }
     {
         Lock xx(mutex);
         if(state==active) return alreadyStartedStatus;
         if(state==deleted) return deletedStatus;
     }
-    pvRecord->addListener(getPtrSelf(),pvCopy);
+    if(share) {
+        epicsGuard <PVRecord> guard(*pvRecord);
+        {
+            Lock xx(mutex);
+            clearQueue();
+            pendingElement.reset();
+            lastQueued = 0;
+            epicsAtomicSetIntT(&state,active);
+        }
+        share->start(getPtrSelf());
+        return Status::Ok;
+    }
+    pvRecord->addChangeSetListener(getPtrSelf());
     epicsGuard <PVRecord> guard(*pvRecord);
     Lock xx(mutex);
-    state = active;
-    queue->clear();
-    isGroupPut = false;
+    // the consumer does not use the queue until state is active
+    activeElement.reset();
+    clearQueue();
+    lastQueued = 0;
+    epicsAtomicSetIntT(&state,active);
     activeElement = queue->getFree();
     activeElement->changedBitSet->clear();
     activeElement->overrunBitSet->clear();
     activeElement->changedBitSet->set(0);
-    releaseActiveElement();
+    if(isAsync) {
+        queueActiveElement();
+        scheduleDispatch(getPtrSelf());
+    } else {
+        releaseActiveElement();
+    }
     return Status::Ok;
 }
 
 Status MonitorLocal::stop()
 {
     if(pvRecord->getTraceLevel()>0){
-        cout << "MonitorLocal::stop state " << state << endl;
+        cout << "MonitorLocal::stop state " << epicsAtomicGetIntT(&state) << endl;
     }
     {
         Lock xx(mutex);
         if(state==idle) return notStartedStatus;
         if(state==deleted) return deletedStatus;
-        state = idle;
+        epicsAtomicSetIntT(&state,idle);
     }
-    pvRecord->removeListener(getPtrSelf(),pvCopy);
+    if(throttle) {
+        getThrottleTimer().cancel(throttle);
+        epicsGuard <PVRecord> guard(*pvRecord);
+        isThrottleScheduled = false;
+    }
+    if(share) {
+        epicsGuard <PVRecord> guard(*pvRecord);
+        // the share can reuse the elements, or give them back to the pool
+        // if this was its last monitor. putShared does nothing while idle.
+        pendingElement.reset();
+        {
+            Lock xx(pollMutex);
+            queue->clear();
+        }
+        share->stop(getPtrSelf());
+        return Status::Ok;
+    }
+    pvRecord->removeChangeSetListener(getPtrSelf());
+    epicsGuard <PVRecord> guard(*pvRecord);
+    // gives the elements back to the pool
+    activeElement.reset();
+    Lock xx(pollMutex);
+    queue->clear();
     return Status::Ok;
 }
 
 MonitorElementPtr MonitorLocal::poll()
 {
-    if(pvRecord->getTraceLevel()>1)
-    {
-        cout << "MonitorLocal::poll state  " << state << endl;
+    if(pvRecord->getTraceLevel()>1) {
+        PVRecordTrace::record(pvRecord.get(),traceMonitorPoll);
     }
-    {
-        Lock xx(queueMutex);
-        if(state!=active) return NULLMonitorElement;
-        return queue->getUsed();
+    Lock xx(pollMutex);
+    if(epicsAtomicGetIntT(&state)!=active) return NULLMonitorElement;
+    MonitorElementPtr element = queue->getUsed();
+    if(!element || overflowPolicy==overflowCoalesce) return element;
+    // elements are released in the order they are polled, so nothing
+    // is dropped while the client holds another element
+    if(queue->getNumberQueued()-queue->getNumberUsed()>1) return element;
+    if(share && isMergedPolled) return element;
+    size_t numberDrop = queue->getNumberUsed();
+    if(overflowPolicy==overflowDropOldest) {
+        // one element for each time the producer found the queue full
+        size_t numberOverflow = queue->takeOverflows();
+        if(numberOverflow<numberDrop) numberDrop = numberOverflow;
+    }
+    while(numberDrop-->0) {
+        MonitorElementPtr next = queue->getUsed();
+        if(!next) break;
+        if(share) {
+            // shared elements are not modified, they are merged into mergedElement
+            mergeSharedElement(element,next);
+            if(element!=mergedElement) queue->releaseUsed(element);
+            queue->releaseUsed(next);
+            element = mergedElement;
+            continue;
+        }
+        mergeElement(element,next);
+        queue->releaseUsed(element);
+        element = next;
+    }
+    if(element==mergedElement) isMergedPolled = true;
+    return element;
+}
+
+// Called by the consumer for two elements it polled.
+// Fields changed in older but not in newer are copied to newer,
+// so a client that only sees newer still gets every changed field.
+// Fields changed in both are marked as overrun in newer.
+void MonitorLocal::mergeElement(
+    MonitorElementPtr const & older,
+    MonitorElementPtr const & newer)
+{
+    PVStructurePtr const & pvOlder = older->pvStructurePtr;
+    PVStructurePtr const & pvNewer = newer->pvStructurePtr;
+    BitSetPtr const & changed = newer->changedBitSet;
+    BitSetPtr const & overrun = newer->overrunBitSet;
+    *overrun |= *older->overrunBitSet;
+    int32 offset = older->changedBitSet->nextSetBit(0);
+    while(offset>=0) {
+        // the changed bit sets are compressed, so a structure bit
+        // stands for all its subfields
+        size_t nextOffset = getField(pvOlder,offset)->getNextFieldOffset();
+        for(size_t i=offset; i<nextOffset; ++i) {
+            PVField * pvNewerField = getField(pvNewer,i);
+            if(pvNewerField->getField()->getType()==structure) continue;
+            if(isCovered(pvNewer,*changed,i)) {
+                overrun->set(i);
+            } else {
+                pvNewerField->copyUnchecked(*getField(pvOlder,i));
+                changed->set(i);
+            }
+        }
+        offset = older->changedBitSet->nextSetBit(nextOffset);
+    }
+    BitSetUtil::compress(changed,pvNewer);
+    BitSetUtil::compress(overrun,pvNewer);
+}
+
+// Called by the consumer with pollMutex held, for two elements of a share.
+// The bit sets are merged and the data of newer is copied into mergedElement,
+// which is taken from the pool the first time. older may be mergedElement.
+void MonitorLocal::mergeSharedElement(
+    MonitorElementPtr const & older,
+    MonitorElementPtr const & newer)
+{
+    if(!mergedElement) {
+        mergedElement = MonitorElementPool::getPool(pvCopy->getStructure())->get();
     }
+    BitSetPtr const & changed = mergedElement->changedBitSet;
+    BitSetPtr const & overrun = mergedElement->overrunBitSet;
+    if(older!=mergedElement) {
+        *changed = *older->changedBitSet;
+        *overrun = *older->overrunBitSet;
+    }
+    mergeSharedBits(*changed,*overrun,newer);
+    // arrays are shared, not copied, by copyUnchecked
+    PVStructurePtr const & pvStructure = mergedElement->pvStructurePtr;
+    pvStructure->copyUnchecked(*newer->pvStructurePtr);
+    BitSetUtil::compress(changed,pvStructure);
+    BitSetUtil::compress(overrun,pvStructure);
 }
 
 void MonitorLocal::release(MonitorElementPtr const & monitorElement)
 {
-    if(pvRecord->getTraceLevel()>1)
-    {
-        cout << "MonitorLocal::release state  " << state << endl;
+    if(pvRecord->getTraceLevel()>1) {
+        PVRecordTrace::record(pvRecord.get(),traceMonitorRelease);
     }
     {
-        Lock xx(queueMutex);
-        if(state!=active) return;
-        queue->releaseUsed(monitorElement);
+        Lock xx(pollMutex);
+        // an element polled before stop is not released to the cleared queue
+        if(epicsAtomicGetIntT(&state)!=active) return;
+        if(monitorElement==mergedElement) {
+            // its shared elements were released by poll
+            isMergedPolled = false;
+        } else {
+            queue->releaseUsed(monitorElement);
+        }
+    }
+    // For latest and dropOldest the newest update must not wait for the
+    // next put to the record. It is queued by dispatch, since release
+    // may be called by a thread that must not wait for the record lock.
+    if(overflowPolicy!=overflowCoalesce && epicsAtomicGetIntT(&isUpdateHeld)) {
+        scheduleDispatch(getPtrSelf());
     }
 }
 
 void MonitorLocal::releaseActiveElement()
 {
-    if(pvRecord->getTraceLevel()>1)
-    {
-        cout << "MonitorLocal::releaseActiveElement  state  " << state << endl;
+    if(queueActiveElement()) notifyRequester();
+}
+
+// Returns true if the active element was queued.
+bool MonitorLocal::queueActiveElement()
+{
+    if(pvRecord->getTraceLevel()>1) {
+        PVRecordTrace::record(pvRecord.get(),traceMonitorReleaseActive);
     }
-    {
-        Lock xx(queueMutex);
-        if(state!=active) return;
-        bool result = pvCopy->updateCopyFromBitSet(activeElement->pvStructurePtr,activeElement->changedBitSet);
-        if(!result) return;
-        MonitorElementPtr newActive = queue->getFree();
-        if(!newActive) return;
-        BitSetUtil::compress(activeElement->changedBitSet,activeElement->pvStructurePtr);
-        BitSetUtil::compress(activeElement->overrunBitSet,activeElement->pvStructurePtr);
-        queue->setUsed(activeElement);
-        activeElement = newActive;
-        activeElement->changedBitSet->clear();
-        activeElement->overrunBitSet->clear();
+    // Only called with the record locked, or by dispatch, so there is one producer.
+    if(epicsAtomicGetIntT(&state)!=active) return false;
+    bool result = pvCopy->updateCopyFromBitSet(activeElement->pvStructurePtr,activeElement->changedBitSet);
+    if(!result) return false;
+    MonitorElementPtr newActive = queue->getFree();
+    if(!newActive && growQueue()) newActive = queue->getFree();
+    if(!newActive) {
+        queue->overflow();
+        epicsAtomicSetIntT(&isUpdateHeld,1);
+        return false;
     }
-    MonitorRequesterPtr requester = monitorRequester.lock();
-    if(!requester) return;
-    requester->monitorEvent(getPtrSelf());
-    return;
+    epicsAtomicSetIntT(&isUpdateHeld,0);
+    BitSetUtil::compress(activeElement->changedBitSet,activeElement->pvStructurePtr);
+    BitSetUtil::compress(activeElement->overrunBitSet,activeElement->pvStructurePtr);
+    countOverrun(*activeElement->overrunBitSet);
+    queue->setUsed(activeElement);
+    shrinkQueue();
+    activeElement = newActive;
+    activeElement->changedBitSet->clear();
+    activeElement->overrunBitSet->clear();
+    return true;
 }
 
-void MonitorLocal::dataPut(PVRecordFieldPtr const & pvRecordField)
+// Called by MonitorShare for each update.
+// element is shared with the other monitors of the share and is not modified.
+// Returns true if an element was queued.
+bool MonitorLocal::putShared(MonitorElementPtr const & element)
 {
-    if(pvRecord->getTraceLevel()>1)
-    {
-        cout << "MonitorLocal::dataPut(pvRecordField)" << endl;
+    if(pvRecord->getTraceLevel()>1) {
+        PVRecordTrace::record(pvRecord.get(),traceMonitorReleaseActive);
     }
-    // If this record field is the master field, and the master field was not
-    // requested, we do not proceed with copy
-    bool isMasterField = pvRecordField->getPVRecord()->getPVStructure()->getFieldOffset()==0;
-    if (isMasterField && !pvCopy->isMasterFieldRequested()) {
-        return;
+    if(epicsAtomicGetIntT(&state)!=active) return false;
+    if(!pendingElement) {
+        *pendingChangedBitSet = *element->changedBitSet;
+        *pendingOverrunBitSet = *element->overrunBitSet;
+    } else {
+        mergeSharedBits(*pendingChangedBitSet,*pendingOverrunBitSet,element);
     }
-    if(state!=active) return;
-    {
-        Lock xx(mutex);
-        size_t offset = pvCopy->getCopyOffset(pvRecordField->getPVField());
-        BitSetPtr const &changedBitSet = activeElement->changedBitSet;
-        BitSetPtr const &overrunBitSet = activeElement->overrunBitSet;
-        bool isSet = changedBitSet->get(offset);
-        changedBitSet->set(offset);
-        if(isSet) overrunBitSet->set(offset);
-        dataChanged = true;
-    }
-    if(!isGroupPut) {
-        releaseActiveElement();
-        dataChanged = false;
+    pendingElement = element;
+    if(isThrottled()) return false;
+    return queuePending();
+}
+
+// Like the active element of a monitor without a share,
+// the updates are held until the queue has room.
+bool MonitorLocal::queuePending()
+{
+    if(!pendingElement) return false;
+    MonitorElementPtr element(pendingElement);
+    if(*pendingChangedBitSet!=*element->changedBitSet
+    || *pendingOverrunBitSet!=*element->overrunBitSet) {
+        element = createSharedElement(element,*pendingChangedBitSet,*pendingOverrunBitSet);
     }
+    if(!queue->put(element) && !(growQueue() && queue->put(element))) {
+        queue->overflow();
+        epicsAtomicSetIntT(&isUpdateHeld,1);
+        return false;
+    }
+    epicsAtomicSetIntT(&isUpdateHeld,0);
+    countOverrun(*pendingOverrunBitSet);
+    pendingElement.reset();
+    shrinkQueue();
+    return true;
 }
 
-void MonitorLocal::dataPut(
-        PVRecordStructurePtr const & requested,
-        PVRecordFieldPtr const & pvRecordField)
+// Called by the producer for each queued update.
+void MonitorLocal::countOverrun(BitSet const & overrunBitSet)
 {
-    if(pvRecord->getTraceLevel()>1)
-    {
-        cout << "MonitorLocal::dataPut(requested,pvRecordField)" << endl;
+    size_t number = overrunBitSet.cardinality();
+    if(number==0) return;
+    epicsAtomicIncrSizeT(&numberOverrun);
+    epicsAtomicAddSizeT(&numberOverrunFields,number);
+}
+
+// Called by the producer when it finds the queue full.
+// Doubles the limit, up to maximumLimit, so the update can be queued
+// instead of being merged into the next one.
+// Returns false if the limit is already maximumLimit.
+bool MonitorLocal::growQueue()
+{
+    size_t limit = queue->getLimit();
+    if(limit>=maximumLimit) return false;
+    queue->setLimit(std::min(limit*2,maximumLimit));
+    numberAdaptQueued = 0;
+    maximumLag = 0;
+    return true;
+}
+
+// Called by the producer each time it queues an update.
+// If the consumer never held more than a quarter of the limit
+// during the last queueShrinkUpdates updates, the limit is halved,
+// down to minimumLimit. A queue with a pool gives the elements
+// it no longer needs back to the pool as the client releases them.
+void MonitorLocal::shrinkQueue()
+{
+    if(maximumLimit==minimumLimit) return;
+    size_t limit = queue->getLimit();
+    size_t lag = queue->getNumberQueued();
+    if(lag>maximumLag) maximumLag = lag;
+    if(++numberAdaptQueued<queueShrinkUpdates) return;
+    if(maximumLag*4<=limit && limit>minimumLimit) {
+        queue->setLimit(std::max(limit/2,minimumLimit));
     }
-    if(state!=active) return;
+    numberAdaptQueued = 0;
+    maximumLag = 0;
+}
+
+// Called with the record locked, so the producer does not use the queue.
+void MonitorLocal::clearQueue()
+{
     {
-        Lock xx(mutex);
-        BitSetPtr const &changedBitSet = activeElement->changedBitSet;
-        BitSetPtr const &overrunBitSet = activeElement->overrunBitSet;
-        size_t offsetCopyRequested = pvCopy->getCopyOffset(
-            requested->getPVField());
-        size_t offset = offsetCopyRequested
-             + (pvRecordField->getPVField()->getFieldOffset()
-                 - requested->getPVField()->getFieldOffset());
-        bool isSet = changedBitSet->get(offset);
-        changedBitSet->set(offset);
-        if(isSet) overrunBitSet->set(offset);
-        dataChanged = true;
-    }
-    if(!isGroupPut) {
+        Lock xx(pollMutex);
+        queue->clear();
+        isMergedPolled = false;
+    }
+    epicsAtomicSetIntT(&isUpdateHeld,0);
+    queue->setLimit(minimumLimit);
+    numberAdaptQueued = 0;
+    maximumLag = 0;
+    epicsAtomicSetSizeT(&numberOverrun,0);
+    epicsAtomicSetSizeT(&numberOverrunFields,0);
+}
+
+// The number of elements a client can hold, polled or not, for a queue limit.
+// The active element of a monitor without a share is one of its limit,
+// the queue of a share only holds elements for the client.
+// Both are queueSize-1 for the queueSize of the request.
+size_t MonitorLocal::getClientLimit(size_t limit) const
+{
+    return share ? limit : limit - 1;
+}
+
+void MonitorLocal::getStats(Stats & stats) const
+{
+    size_t numberUsed = queue->getNumberUsed();
+    size_t numberQueued = queue->getNumberQueued();
+    size_t limit = getClientLimit(queue->getLimit());
+    stats.nfilled = numberUsed;
+    stats.noutstanding = numberQueued - numberUsed;
+    stats.nempty = numberQueued<limit ? limit - numberQueued : 0;
+}
+
+void MonitorLocal::getLocalStats(MonitorLocalStats & stats)
+{
+    // the same quantity as the limit of getStats
+    stats.queueSize = getClientLimit(queue->getLimit());
+    stats.minQueueSize = getClientLimit(minimumLimit);
+    stats.maxQueueSize = getClientLimit(maximumLimit);
+    stats.numberUsed = queue->getNumberUsed();
+    stats.numberOverflow = queue->getNumberOverflow();
+    stats.numberOverrun = epicsAtomicGetSizeT(&numberOverrun);
+    stats.numberOverrunFields = epicsAtomicGetSizeT(&numberOverrunFields);
+}
+
+// Called with the record locked before an update is queued.
+// Returns true if the update must wait for the throttle timer.
+bool MonitorLocal::isThrottled()
+{
+    if(minimumInterval==0) return false;
+    if(isThrottleScheduled) return true;
+    epicsUInt64 now = epicsMonotonicGet();
+    if(lastQueued==0 || now-lastQueued>=minimumInterval) {
+        lastQueued = now;
+        return false;
+    }
+    isThrottleScheduled = true;
+    double delay = (lastQueued + minimumInterval - now)*1e-9;
+    getThrottleTimer().scheduleAfterDelay(throttle,delay);
+    return true;
+}
+
+// Called by the throttle timer. The updates held back are queued
+// even if no further puts are made to the record.
+void MonitorLocal::throttleExpired()
+{
+    epicsGuard <PVRecord> guard(*pvRecord);
+    if(!isThrottleScheduled) return;
+    isThrottleScheduled = false;
+    if(epicsAtomicGetIntT(&state)!=active) return;
+    lastQueued = epicsMonotonicGet();
+    if(share) {
+        if(queuePending()) eventQueued();
+    } else if(isAsync) {
+        scheduleDispatch(getPtrSelf());
+    } else {
         releaseActiveElement();
-        dataChanged = false;
     }
 }
 
-void MonitorLocal::beginGroupPut(PVRecordPtr const & pvRecord)
+void MonitorLocal::eventQueued()
 {
-    if(pvRecord->getTraceLevel()>1)
-    {
-        cout << "MonitorLocal::beginGroupPut()" << endl;
+    if(isAsync) {
+        scheduleDispatch(getPtrSelf());
+    } else {
+        notifyRequester();
     }
-    if(state!=active) return;
-    {
-        Lock xx(mutex);
-        isGroupPut = true;
-        dataChanged = false;
+}
+
+void MonitorLocal::notifyRequester()
+{
+    MonitorRequesterPtr requester = monitorRequester.lock();
+    if(!requester) return;
+    requester->monitorEvent(getPtrSelf());
+}
+
+// Runs on the dispatch pool without the record lock held.
+// The active element is copied with the record locked for readers,
+// which lets the dispatch of other monitors of the record run at the same time.
+void MonitorLocal::dispatch()
+{
+    if(epicsAtomicGetIntT(&isUpdateHeld)) {
+        queueHeldUpdate();
+    } else if(!share) {
+        PVRecordSharedGuard guard(*pvRecord);
+        queueActiveElement();
     }
+    // also covers an element queued by start
+    if(queue->getNumberUsed()>0) notifyRequester();
 }
 
-void MonitorLocal::endGroupPut(PVRecordPtr const & pvRecord)
+// Called by dispatch after release made room for an update that was held.
+// The pending element of a share is also used by MonitorShare::publish,
+// which an async share runs with the record locked for readers,
+// so the record is locked here.
+void MonitorLocal::queueHeldUpdate()
 {
-    if(pvRecord->getTraceLevel()>1)
-    {
-        cout << "MonitorLocal::endGroupPut dataChanged " << dataChanged << endl;
+    epicsGuard <PVRecord> guard(*pvRecord);
+    if(epicsAtomicGetIntT(&state)!=active) return;
+    // a throttled update is queued by the throttle timer
+    if(isThrottled()) return;
+    if(share) {
+        queuePending();
+    } else {
+        queueActiveElement();
+    }
+}
+
+void MonitorLocal::dataPutChangeSet(
+    PVRecordPtr const & pvRecord,
+    BitSetPtr const & changedBitSet)
+{
+    if(pvRecord->getTraceLevel()>1) {
+        // the offset of the first field of the change set
+        PVRecordTrace::record(pvRecord.get(),traceMonitorDataPut,
+            changedBitSet->nextSetBit(0));
     }
-    if(state!=active) return;
+    if(epicsAtomicGetIntT(&state)!=active) return;
     {
         Lock xx(mutex);
-        isGroupPut = false;
+        int32 offset = changedBitSet->nextSetBit(0);
+        while(offset>=0) {
+            setChangedMaster(pvRecord,pvCopy,firstLeafOffset,offset,
+                *activeElement->changedBitSet,activeElement->overrunBitSet.get());
+            offset = changedBitSet->nextSetBit(offset+1);
+        }
     }
-    if(dataChanged) {
-        dataChanged = false;
+    // the changes stay in the active element until the throttle expires
+    if(isThrottled()) return;
+    if(isAsync) {
+        // the copy is made by dispatch
+        scheduleDispatch(getPtrSelf());
+    } else {
         releaseActiveElement();
     }
 }
@@ -383,7 +1595,7 @@ void MonitorLocal::unlisten(PVRecordPtr const & pvRecord)
     }
     {
         Lock xx(mutex);
-        state = deleted;
+        epicsAtomicSetIntT(&state,deleted);
     }
     MonitorRequesterPtr requester = monitorRequester.lock();
     if(requester) {
@@ -400,6 +1612,7 @@ bool MonitorLocal::init(PVStructurePtr const & pvRequest)
 {
     PVFieldPtr pvField;
     size_t queueSize = 2;
+    size_t maxQueueSize = 0;
     PVStructurePtr pvOptions = pvRequest->getSubField<PVStructure>("record._options");
     MonitorRequesterPtr requester = monitorRequester.lock();
     if(!requester) return false;
@@ -417,6 +1630,62 @@ bool MonitorLocal::init(PVStructurePtr const & pvRequest)
                  return false;
             }
         }
+        pvString = pvOptions->getSubField<PVString>("maxQueueSize");
+        if(pvString) {
+            int32 size = 0;
+            std::stringstream ss;
+            ss << pvString->get();
+            ss >> size;
+            if(ss.fail() || size<=0) {
+                requester->message("maxQueueSize " + pvString->get()
+                    + " illegal, must be greater than 0",errorMessage);
+                return false;
+            }
+            maxQueueSize = size;
+        }
+        pvString = pvOptions->getSubField<PVString>("overflow");
+        if(pvString) {
+            string overflow = pvString->get();
+            if(overflow=="coalesce") {
+                overflowPolicy = overflowCoalesce;
+            } else if(overflow=="dropOldest") {
+                overflowPolicy = overflowDropOldest;
+            } else if(overflow=="latest") {
+                overflowPolicy = overflowLatest;
+            } else {
+                requester->message("overflow " + overflow
+                    + " illegal, must be coalesce, dropOldest or latest",errorMessage);
+                return false;
+            }
+        }
+        pvString = pvOptions->getSubField<PVString>("maxRate");
+        if(pvString) {
+            double maxRate = 0.0;
+            std::stringstream ss;
+            ss << pvString->get();
+            ss >> maxRate;
+            if(ss.fail() || maxRate<=0.0) {
+                requester->message("maxRate " + pvString->get()
+                    + " illegal, must be greater than 0",errorMessage);
+                return false;
+            }
+            minimumInterval = static_cast<epicsUInt64>(1e9/maxRate);
+            if(minimumInterval==0) minimumInterval = 1;
+            throttle = TimerCallbackPtr(new MonitorThrottle(getPtrSelf()));
+        }
+        pvString = pvOptions->getSubField<PVString>("dispatch");
+        if(pvString) {
+            string dispatch = pvString->get();
+            if(dispatch=="sync") {
+                isAsync = false;
+            } else if(dispatch=="async") {
+                isAsync = true;
+            } else {
+                requester->message("dispatch " + dispatch
+                    + " illegal, must be sync or async",errorMessage);
+                return false;
+            }
+        }
     }
     pvField = pvRequest->getSubField("field");
     if(!pvField) {
@@ -440,16 +1709,30 @@ bool MonitorLocal::init(PVStructurePtr const & pvRequest)
             return false;
         }
     }
+    firstLeafOffset = getFirstLeafOffset(pvRecord);
     if(queueSize<2) queueSize = 2;
-    std::vector<MonitorElementPtr> monitorElementArray;
-    monitorElementArray.reserve(queueSize);
-    for(size_t i=0; i<queueSize; i++) {
-         PVStructurePtr pvStructure = pvCopy->createPVStructure();
-         MonitorElementPtr monitorElement(
-             new MonitorElement(pvStructure));
-         monitorElementArray.push_back(monitorElement);
-    }
-    queue = MonitorElementQueuePtr(new MonitorElementQueue(monitorElementArray));
+    if(maxQueueSize<queueSize) maxQueueSize = queueSize;
+    if(!pvCopy->hasFilters()) {
+        // Filters keep state for each client, so only monitors without
+        // filters can share the copy.
+        share = MonitorShare::getShare(pvRecord,pvRequest,pvCopy,isAsync);
+        // The active element of a monitor without a share is one of
+        // queueSize, so the same number of updates can be queued.
+        minimumLimit = queueSize-1;
+        maximumLimit = maxQueueSize-1;
+        // the queue holds elements of the share, which takes them from the pool
+        queue = MonitorElementQueuePtr(
+            new MonitorElementQueue(maximumLimit,MonitorElementPoolPtr()));
+        pendingChangedBitSet = BitSetPtr(new BitSet());
+        pendingOverrunBitSet = BitSetPtr(new BitSet());
+    } else {
+        minimumLimit = queueSize;
+        maximumLimit = maxQueueSize;
+        // the elements are taken from the pool when the queue needs them
+        queue = MonitorElementQueuePtr(new MonitorElementQueue(
+            maximumLimit,MonitorElementPool::getPool(pvCopy->getStructure())));
+    }
+    queue->setLimit(minimumLimit);
     requester->monitorConnect(
         Status::Ok,
         getPtrSelf(),
@@ -457,6 +1740,14 @@ bool MonitorLocal::init(PVStructurePtr const & pvRequest)
     return true;
 }
 
+bool getMonitorLocalStats(MonitorPtr const & monitor,MonitorLocalStats & stats)
+{
+    MonitorLocalPtr monitorLocal = std::tr1::dynamic_pointer_cast<MonitorLocal>(monitor);
+    if(!monitorLocal) return false;
+    monitorLocal->getLocalStats(stats);
+    return true;
+}
+
 MonitorPtr createMonitorLocal(
     PVRecordPtr const & pvRecord,
     MonitorRequester::shared_pointer const & monitorRequester,
@@ -31,17 +31,38 @@ using namespace epics::pvData;
 using namespace epics::pvAccess;
 using namespace epics::pvDatabase;
 
+static const iocshArg pvdblArg0 = { "pattern", iocshArgString };
+static const iocshArg *pvdblArgs[] = {&pvdblArg0};
 static const iocshFuncDef pvdblFuncDef = {
-    "pvdbl", 0, 0
+    "pvdbl", 1, pvdblArgs
 };
 extern "C" void pvdbl(const iocshArgBuf *args)
 {
     PVDatabasePtr master = PVDatabase::getMaster();
-    PVStringArrayPtr pvNames = master->getRecordNames();
-    PVStringArray::const_svector xxx = pvNames->view();
+    char *pattern = args[0].sval;
+    PVStringArray::const_svector xxx = pattern ?
+        master->findRecords(pattern) : master->getRecordNameList();
     for(size_t i=0; i<xxx.size(); ++i) cout<< xxx[i] << endl;
 }
 
+static const iocshArg pvdbSnapshotArg0 = { "pattern", iocshArgString };
+static const iocshArg pvdbSnapshotArg1 = { "enable", iocshArgInt };
+static const iocshArg *pvdbSnapshotArgs[] = {&pvdbSnapshotArg0,&pvdbSnapshotArg1};
+static const iocshFuncDef pvdbSnapshotFuncDef = {
+    "pvdbSnapshot", 2, pvdbSnapshotArgs
+};
+extern "C" void pvdbSnapshot(const iocshArgBuf *args)
+{
+    char *pattern = args[0].sval;
+    if(!pattern) {
+        cout << "pvdbSnapshot pattern not specified" << endl;
+        return;
+    }
+    size_t number = PVDatabase::getMaster()->setSnapshotEnabled(
+        pattern,args[1].ival!=0);
+    cout << "pvdbSnapshot " << number << " records" << endl;
+}
+
 
 static void registerChannelProviderLocal(void)
 {
@@ -49,6 +70,7 @@ static void registerChannelProviderLocal(void)
     if (firstTime) {
         firstTime = 0;
         iocshRegister(&pvdblFuncDef, pvdbl);
+        iocshRegister(&pvdbSnapshotFuncDef, pvdbSnapshot);
         getChannelProviderLocal();
     }
 }
@@ -0,0 +1,137 @@
+/*
+ * Copyright information and license terms for this software can be
+ * found in the file LICENSE that is included with the distribution
+ */
+
+#include <iocsh.h>
+#include <pv/pvData.h>
+#include <pv/pvAccess.h>
+#include <pv/rpcService.h>
+
+#include <epicsExport.h>
+#define epicsExportSharedSymbols
+#include "pv/pvDatabase.h"
+#include "pv/pvdbcrFindRecord.h"
+using namespace epics::pvData;
+using namespace epics::pvAccess;
+using namespace std;
+
+namespace epics { namespace pvDatabase {
+
+class FindRecordService :
+    public RPCService
+{
+public:
+    POINTER_DEFINITIONS(FindRecordService);
+    virtual ~FindRecordService() {}
+    virtual PVStructurePtr request(PVStructurePtr const & args)
+    {
+        PVStringPtr pvPattern = args->getSubField<PVString>("pattern");
+        if(!pvPattern) {
+            throw RPCRequestException(Status::STATUSTYPE_ERROR,
+                "request must have string pattern");
+        }
+        PVStructurePtr result = getPVDataCreate()->createPVStructure(
+            getFieldCreate()->createFieldBuilder()->
+                addArray("names",pvString)->
+                createStructure());
+        result->getSubField<PVStringArray>("names")->replace(
+            PVDatabase::getMaster()->findRecords(pvPattern->get()));
+        return result;
+    }
+};
+
+PvdbcrFindRecordPtr PvdbcrFindRecord::create(
+    std::string const & recordName,
+    int asLevel,std::string const & asGroup)
+{
+    FieldCreatePtr fieldCreate = getFieldCreate();
+    PVDataCreatePtr pvDataCreate = getPVDataCreate();
+    StructureConstPtr  topStructure = fieldCreate->createFieldBuilder()->
+        addNestedStructure("argument")->
+            add("pattern",pvString)->
+            endNested()->
+        addNestedStructure("result") ->
+            addArray("names",pvString) ->
+            endNested()->
+        createStructure();
+    PVStructurePtr pvStructure = pvDataCreate->createPVStructure(topStructure);
+    PvdbcrFindRecordPtr pvRecord(
+        new PvdbcrFindRecord(recordName,pvStructure,
+        asLevel,asGroup));
+    if(!pvRecord->init()) pvRecord.reset();
+    return pvRecord;
+}
+
+PvdbcrFindRecord::PvdbcrFindRecord(
+    std::string const & recordName,
+    epics::pvData::PVStructurePtr const & pvStructure,
+    int asLevel,std::string const & asGroup)
+: PVRecord(recordName,pvStructure,asLevel,asGroup)
+{
+}
+
+bool PvdbcrFindRecord::init()
+{
+    initPVRecord();
+    PVStructurePtr pvStructure = getPVStructure();
+    pvPattern = pvStructure->getSubField<PVString>("argument.pattern");
+    if(!pvPattern) return false;
+    pvNames = pvStructure->getSubField<PVStringArray>("result.names");
+    if(!pvNames) return false;
+    return true;
+}
+
+void PvdbcrFindRecord::process()
+{
+    pvNames->replace(PVDatabase::getMaster()->findRecords(pvPattern->get()));
+}
+
+RPCServiceAsync::shared_pointer PvdbcrFindRecord::getService(
+    PVStructurePtr const & pvRequest)
+{
+    return FindRecordService::shared_pointer(new FindRecordService());
+}
+
+}}
+
+static const iocshArg arg0 = { "recordName", iocshArgString };
+static const iocshArg arg1 = { "asLevel", iocshArgInt };
+static const iocshArg arg2 = { "asGroup", iocshArgString };
+static const iocshArg *args[] = {&arg0,&arg1,&arg2};
+
+static const iocshFuncDef pvdbcrFindRecordFuncDef = {"pvdbcrFindRecord", 3,args};
+
+static void pvdbcrFindRecordCallFunc(const iocshArgBuf *args)
+{
+    char *sval = args[0].sval;
+    if(!sval) {
+        throw std::runtime_error("pvdbcrFindRecord recordName not specified");
+    }
+    string recordName = string(sval);
+    int asLevel = args[1].ival;
+    string asGroup("DEFAULT");
+    sval = args[2].sval;
+    if(sval) {
+        asGroup = string(sval);
+    }
+    epics::pvDatabase::PvdbcrFindRecordPtr record = epics::pvDatabase::PvdbcrFindRecord::create(recordName);
+    record->setAsLevel(asLevel);
+    record->setAsGroup(asGroup);
+    epics::pvDatabase::PVDatabasePtr master = epics::pvDatabase::PVDatabase::getMaster();
+    bool result =  master->addRecord(record);
+    if(!result) cout << "recordname " << recordName << " not added" << endl;
+}
+
+static void pvdbcrFindRecord(void)
+{
+    static int firstTime = 1;
+    if (firstTime) {
+        firstTime = 0;
+        iocshRegister(&pvdbcrFindRecordFuncDef, pvdbcrFindRecordCallFunc);
+    }
+}
+
+extern "C" {
+    epicsExportRegistrar(pvdbcrFindRecord);
+}
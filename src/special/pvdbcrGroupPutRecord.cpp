@@ -0,0 +1,195 @@
+/*
+ * Copyright information and license terms for this software can be
+ * found in the file LICENSE that is included with the distribution
+ */
+
+#include <iocsh.h>
+#include <epicsGuard.h>
+#include <pv/pvData.h>
+#include <pv/convert.h>
+#include <pv/pvAccess.h>
+#include <pv/rpcService.h>
+
+#include <epicsExport.h>
+#define epicsExportSharedSymbols
+#include "pv/pvDatabase.h"
+#include "pv/pvdbcrGroupPutRecord.h"
+using namespace epics::pvData;
+using namespace epics::pvAccess;
+using namespace std;
+
+namespace epics { namespace pvDatabase {
+
+class GroupPutService :
+    public RPCService
+{
+public:
+    POINTER_DEFINITIONS(GroupPutService);
+    virtual ~GroupPutService() {}
+    virtual PVStructurePtr request(PVStructurePtr const & args)
+    {
+        PVStringArrayPtr pvRecordNames = args->getSubField<PVStringArray>("recordName");
+        PVStringArrayPtr pvFieldNames = args->getSubField<PVStringArray>("fieldName");
+        PVStringArrayPtr pvValues = args->getSubField<PVStringArray>("value");
+        if(!pvRecordNames || !pvFieldNames || !pvValues) {
+            throw RPCRequestException(Status::STATUSTYPE_ERROR,
+                "request must have string arrays recordName, fieldName and value");
+        }
+        string status = PvdbcrGroupPutRecord::groupPut(
+            pvRecordNames->view(),pvFieldNames->view(),pvValues->view());
+        if(status!="success") {
+            throw RPCRequestException(Status::STATUSTYPE_ERROR,status);
+        }
+        PVStructurePtr result = getPVDataCreate()->createPVStructure(
+            getFieldCreate()->createFieldBuilder()->
+                add("status",pvString)->
+                createStructure());
+        result->getSubField<PVString>("status")->put(status);
+        return result;
+    }
+};
+
+PvdbcrGroupPutRecordPtr PvdbcrGroupPutRecord::create(
+    std::string const & recordName,
+    int asLevel,std::string const & asGroup)
+{
+    FieldCreatePtr fieldCreate = getFieldCreate();
+    PVDataCreatePtr pvDataCreate = getPVDataCreate();
+    StructureConstPtr  topStructure = fieldCreate->createFieldBuilder()->
+        addNestedStructure("argument")->
+            addArray("recordName",pvString)->
+            addArray("fieldName",pvString)->
+            addArray("value",pvString)->
+            endNested()->
+        addNestedStructure("result") ->
+            add("status",pvString) ->
+            endNested()->
+        createStructure();
+    PVStructurePtr pvStructure = pvDataCreate->createPVStructure(topStructure);
+    PvdbcrGroupPutRecordPtr pvRecord(
+        new PvdbcrGroupPutRecord(recordName,pvStructure,
+        asLevel,asGroup));
+    if(!pvRecord->init()) pvRecord.reset();
+    return pvRecord;
+}
+
+PvdbcrGroupPutRecord::PvdbcrGroupPutRecord(
+    std::string const & recordName,
+    epics::pvData::PVStructurePtr const & pvStructure,
+    int asLevel,std::string const & asGroup)
+: PVRecord(recordName,pvStructure,asLevel,asGroup)
+{
+}
+
+bool PvdbcrGroupPutRecord::init()
+{
+    initPVRecord();
+    PVStructurePtr pvStructure = getPVStructure();
+    pvRecordNames = pvStructure->getSubField<PVStringArray>("argument.recordName");
+    if(!pvRecordNames) return false;
+    pvFieldNames = pvStructure->getSubField<PVStringArray>("argument.fieldName");
+    if(!pvFieldNames) return false;
+    pvValues = pvStructure->getSubField<PVStringArray>("argument.value");
+    if(!pvValues) return false;
+    pvResult = pvStructure->getSubField<PVString>("result.status");
+    if(!pvResult) return false;
+    return true;
+}
+
+string PvdbcrGroupPutRecord::groupPut(
+    PVStringArray::const_svector const & recordNames,
+    PVStringArray::const_svector const & fieldNames,
+    PVStringArray::const_svector const & values)
+{
+    size_t num = recordNames.size();
+    if(fieldNames.size()!=num || values.size()!=num) {
+        return "recordName, fieldName and value must have the same length";
+    }
+    // resolve and convert everything before any record is locked
+    PVDatabasePtr master = PVDatabase::getMaster();
+    PVRecordPtrArray pvRecords(num);
+    vector<PVScalarPtr> pvFields(num);
+    vector<PVScalarPtr> pvNewValues(num);
+    for(size_t i=0; i<num; ++i) {
+        pvRecords[i] = master->findRecord(recordNames[i]);
+        if(!pvRecords[i]) return recordNames[i] + " not found";
+        pvFields[i] = pvRecords[i]->getPVStructure()->getSubField<PVScalar>(fieldNames[i]);
+        if(!pvFields[i]) {
+            return recordNames[i] + " " + fieldNames[i] + " is not a scalar field";
+        }
+        pvNewValues[i] = getPVDataCreate()->createPVScalar(pvFields[i]->getScalar());
+        try {
+            getConvert()->fromString(pvNewValues[i],values[i]);
+        } catch(std::exception& e) {
+            return recordNames[i] + " " + fieldNames[i] + " " + e.what();
+        }
+    }
+    PVRecordLockSet lockSet(pvRecords);
+    epicsGuard<PVRecordLockSet> guard(lockSet);
+    lockSet.beginGroupPut();
+    for(size_t i=0; i<num; ++i) {
+        pvFields[i]->copyUnchecked(*pvNewValues[i]);
+    }
+    lockSet.endGroupPut();
+    return "success";
+}
+
+void PvdbcrGroupPutRecord::process()
+{
+    // The caller holds the lock of this record, perhaps inside its own
+    // group put. Locking the other records now could invert the order
+    // of a PVRecordLockSet, and releasing the lock of this record would
+    // let other puts into the caller's group put.
+    // So the group put is only done by the channelRPC service,
+    // which does not hold the lock of any record.
+    pvResult->put("a group put is only done by a channelRPC request");
+}
+
+RPCServiceAsync::shared_pointer PvdbcrGroupPutRecord::getService(
+    PVStructurePtr const & pvRequest)
+{
+    return GroupPutService::shared_pointer(new GroupPutService());
+}
+
+}}
+
+static const iocshArg arg0 = { "recordName", iocshArgString };
+static const iocshArg arg1 = { "asLevel", iocshArgInt };
+static const iocshArg arg2 = { "asGroup", iocshArgString };
+static const iocshArg *args[] = {&arg0,&arg1,&arg2};
+
+static const iocshFuncDef pvdbcrGroupPutRecordFuncDef = {"pvdbcrGroupPutRecord", 3,args};
+
+static void pvdbcrGroupPutRecordCallFunc(const iocshArgBuf *args)
+{
+    char *sval = args[0].sval;
+    if(!sval) {
+        throw std::runtime_error("pvdbcrGroupPutRecord recordName not specified");
+    }
+    string recordName = string(sval);
+    int asLevel = args[1].ival;
+    string asGroup("DEFAULT");
+    sval = args[2].sval;
+    if(sval) {
+        asGroup = string(sval);
+    }
+    epics::pvDatabase::PvdbcrGroupPutRecordPtr record = epics::pvDatabase::PvdbcrGroupPutRecord::create(recordName);
+    record->setAsLevel(asLevel);
+    record->setAsGroup(asGroup);
+    epics::pvDatabase::PVDatabasePtr master = epics::pvDatabase::PVDatabase::getMaster();
+    bool result =  master->addRecord(record);
+    if(!result) cout << "recordname " << recordName << " not added" << endl;
+}
+
+static void pvdbcrGroupPutRecord(void)
+{
+    static int firstTime = 1;
+    if (firstTime) {
+        firstTime = 0;
+        iocshRegister(&pvdbcrGroupPutRecordFuncDef, pvdbcrGroupPutRecordCallFunc);
+    }
+}
+
+extern "C" {
+    epicsExportRegistrar(pvdbcrGroupPutRecord);
+}
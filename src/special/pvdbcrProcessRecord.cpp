@@ -147,7 +147,7 @@ void PvdbcrProcessRecord::run()
            pvRecord->lock();
            pvRecord->beginGroupPut();
            try {
-               pvRecord->process();
+               pvRecord->timedProcess();
            } catch (std::exception& ex) {
                std::cout << "record " << pvRecord->getRecordName() << "exception " << ex.what() << "\n";
            } catch (...) {
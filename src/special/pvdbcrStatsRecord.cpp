@@ -0,0 +1,143 @@
+/*
+ * Copyright information and license terms for this software can be
+ * found in the file LICENSE that is included with the distribution
+ */
+
+#include <iocsh.h>
+#include <pv/standardField.h>
+#include <pv/standardPVField.h>
+#include <pv/timeStamp.h>
+#include <pv/pvTimeStamp.h>
+#include <pv/alarm.h>
+#include <pv/pvAlarm.h>
+#include <pv/pvAccess.h>
+#include <pv/serverContext.h>
+#include <pv/rpcService.h>
+
+#include <epicsExport.h>
+#define epicsExportSharedSymbols
+#include "pv/pvDatabase.h"
+#include "pv/pvdbcrStatsRecord.h"
+using namespace epics::pvData;
+using namespace std;
+
+namespace epics { namespace pvDatabase {
+
+PvdbcrStatsRecordPtr PvdbcrStatsRecord::create(
+    std::string const & recordName,
+    int asLevel,std::string const & asGroup)
+{
+    FieldCreatePtr fieldCreate = getFieldCreate();
+    PVDataCreatePtr pvDataCreate = getPVDataCreate();
+    StructureConstPtr  topStructure = fieldCreate->createFieldBuilder()->
+        addNestedStructure("argument")->
+            add("recordName",pvString)->
+            endNested()->
+        addNestedStructure("result") ->
+            add("status",pvString) ->
+            add("numberProcess",pvULong) ->
+            add("processTime",pvDouble) ->
+            addArray("processHistogram",pvULong) ->
+            add("numberGroupPut",pvULong) ->
+            add("numberLock",pvULong) ->
+            add("numberLockWait",pvULong) ->
+            add("lockWaitTime",pvDouble) ->
+            add("numberListeners",pvULong) ->
+            add("numberMonitors",pvULong) ->
+            add("numberClients",pvULong) ->
+            endNested()->
+        createStructure();
+    PVStructurePtr pvStructure = pvDataCreate->createPVStructure(topStructure);
+    PvdbcrStatsRecordPtr pvRecord(
+        new PvdbcrStatsRecord(recordName,pvStructure,
+        asLevel,asGroup));
+    if(!pvRecord->init()) pvRecord.reset();
+    return pvRecord;
+}
+
+PvdbcrStatsRecord::PvdbcrStatsRecord(
+    std::string const & recordName,
+    epics::pvData::PVStructurePtr const & pvStructure,
+    int asLevel,std::string const & asGroup)
+: PVRecord(recordName,pvStructure,asLevel,asGroup)
+{
+}
+
+bool PvdbcrStatsRecord::init()
+{
+    initPVRecord();
+    PVStructurePtr pvStructure = getPVStructure();
+    pvRecordName = pvStructure->getSubField<PVString>("argument.recordName");
+    if(!pvRecordName) return false;
+    pvResult = pvStructure->getSubField<PVString>("result.status");
+    if(!pvResult) return false;
+    pvStats = pvStructure->getSubField<PVStructure>("result");
+    if(!pvStats) return false;
+    return true;
+}
+
+void PvdbcrStatsRecord::process()
+{
+    string name = pvRecordName->get();
+    PVRecordPtr pvRecord = PVDatabase::getMaster()->findRecord(name);
+    if(!pvRecord) {
+        pvResult->put(name + " not found");
+        return;
+    }
+    PVRecordStats stats = pvRecord->getStats();
+    pvStats->getSubField<PVULong>("numberProcess")->put(stats.numberProcess);
+    pvStats->getSubField<PVDouble>("processTime")->put(stats.processTime);
+    PVULongArray::svector histogram(PVRecordStats::numberProcessBins);
+    for(size_t i=0; i<histogram.size(); ++i) histogram[i] = stats.processHistogram[i];
+    pvStats->getSubField<PVULongArray>("processHistogram")->replace(freeze(histogram));
+    pvStats->getSubField<PVULong>("numberGroupPut")->put(stats.numberGroupPut);
+    pvStats->getSubField<PVULong>("numberLock")->put(stats.numberLock);
+    pvStats->getSubField<PVULong>("numberLockWait")->put(stats.numberLockWait);
+    pvStats->getSubField<PVDouble>("lockWaitTime")->put(stats.lockWaitTime);
+    pvStats->getSubField<PVULong>("numberListeners")->put(stats.numberListeners);
+    pvStats->getSubField<PVULong>("numberMonitors")->put(stats.numberMonitors);
+    pvStats->getSubField<PVULong>("numberClients")->put(stats.numberClients);
+    pvResult->put("success");
+}
+}}
+
+static const iocshArg arg0 = { "recordName", iocshArgString };
+static const iocshArg arg1 = { "asLevel", iocshArgInt };
+static const iocshArg arg2 = { "asGroup", iocshArgString };
+static const iocshArg *args[] = {&arg0,&arg1,&arg2};
+
+static const iocshFuncDef pvdbcrStatsRecordFuncDef = {"pvdbcrStatsRecord", 3,args};
+
+static void pvdbcrStatsRecordCallFunc(const iocshArgBuf *args)
+{
+    char *sval = args[0].sval;
+    if(!sval) {
+        throw std::runtime_error("pvdbcrStatsRecord recordName not specified");
+    }
+    string recordName = string(sval);
+    int asLevel = args[1].ival;
+    string asGroup("DEFAULT");
+    sval = args[2].sval;
+    if(sval) {
+        asGroup = string(sval);
+    }
+    epics::pvDatabase::PvdbcrStatsRecordPtr record = epics::pvDatabase::PvdbcrStatsRecord::create(recordName);
+    record->setAsLevel(asLevel);
+    record->setAsGroup(asGroup);
+    epics::pvDatabase::PVDatabasePtr master = epics::pvDatabase::PVDatabase::getMaster();
+    bool result =  master->addRecord(record);
+    if(!result) cout << "recordname " << recordName << " not added" << endl;
+}
+
+static void pvdbcrStatsRecord(void)
+{
+    static int firstTime = 1;
+    if (firstTime) {
+        firstTime = 0;
+        iocshRegister(&pvdbcrStatsRecordFuncDef, pvdbcrStatsRecordCallFunc);
+    }
+}
+
+extern "C" {
+    epicsExportRegistrar(pvdbcrStatsRecord);
+}
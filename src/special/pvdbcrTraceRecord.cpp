@@ -7,6 +7,7 @@
  * @author mrk
  * @date 2021.04.07
  */
+#include <sstream>
 #include <iocsh.h>
 #include <pv/standardField.h>
 #include <pv/standardPVField.h>
@@ -22,6 +23,7 @@
 #include <epicsExport.h>
 #define epicsExportSharedSymbols
 #include "pv/pvDatabase.h"
+#include "pv/pvRecordTrace.h"
 #include "pv/pvdbcrTraceRecord.h"
 using namespace epics::pvData;
 using namespace std;
@@ -38,9 +40,11 @@ PvdbcrTraceRecordPtr PvdbcrTraceRecord::create(
         addNestedStructure("argument")->
             add("recordName",pvString)->
             add("level",pvInt)->
+            add("dump",pvBoolean)->
             endNested()->
         addNestedStructure("result") ->
             add("status",pvString) ->
+            addArray("trace",pvString) ->
             endNested()->
         createStructure();
     PVStructurePtr pvStructure = pvDataCreate->createPVStructure(topStructure);
@@ -67,8 +71,12 @@ bool PvdbcrTraceRecord::init()
     if(!pvRecordName) return false;
     pvLevel = pvStructure->getSubField<PVInt>("argument.level");
     if(!pvLevel) return false;
+    pvDump = pvStructure->getSubField<PVBoolean>("argument.dump");
+    if(!pvDump) return false;
     pvResult = pvStructure->getSubField<PVString>("result.status");
     if(!pvResult) return false;
+    pvTrace = pvStructure->getSubField<PVStringArray>("result.trace");
+    if(!pvTrace) return false;
     return true;
 }
 
@@ -80,9 +88,30 @@ void PvdbcrTraceRecord::process()
         pvResult->put(name + " not found");
         return;
     }
-    pvRecord->setTraceLevel(pvLevel->get());
+    if(pvDump->get()) {
+        dumpTrace(pvRecord);
+    } else {
+        pvRecord->setTraceLevel(pvLevel->get());
+    }
     pvResult->put("success");
 }
+
+void PvdbcrTraceRecord::dumpTrace(PVRecordPtr const & pvRecord)
+{
+    vector<PVRecordTraceEvent> events;
+    PVRecordTrace::getEvents(pvRecord.get(),events);
+    PVStringArray::svector trace(events.size());
+    for(size_t i=0; i<events.size(); ++i) {
+        PVRecordTraceEvent const & event = events[i];
+        ostringstream line;
+        line << event.time - events[0].time << "ns"
+             << " " << event.threadName
+             << " " << PVRecordTrace::getOpName(event.op)
+             << " " << event.fieldOffset;
+        trace[i] = line.str();
+    }
+    pvTrace->replace(freeze(trace));
+}
 }}
 
 static const iocshArg arg0 = { "recordName", iocshArgString };
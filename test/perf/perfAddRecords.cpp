@@ -0,0 +1,81 @@
+/* perfAddRecords.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures the time to add and remove many records, either one at a time
+ * with PVDatabase::addRecord or with PVDatabase::addRecords.
+ *
+ * usage: perfAddRecords [nrecords] [nthreads]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <epicsTime.h>
+
+#include <pv/pvData.h>
+#include <pv/pvDatabase.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvDatabase;
+
+static PVRecordPtrArray createRecords(size_t nrecords)
+{
+    StructureConstPtr structure = getFieldCreate()->createFieldBuilder()->
+        add("value",pvDouble)->createStructure();
+    PVRecordPtrArray pvRecords(nrecords);
+    for(size_t i=0; i<nrecords; ++i) {
+        std::stringstream ss;
+        ss << "perfAdd:" << i;
+        pvRecords[i] = PVRecord::create(
+            ss.str(),getPVDataCreate()->createPVStructure(structure));
+    }
+    return pvRecords;
+}
+
+static void measure(size_t nrecords,size_t nthreads)
+{
+    PVDatabasePtr master = PVDatabase::getMaster();
+    PVRecordPtrArray pvRecords = createRecords(nrecords);
+    epicsTime start = epicsTime::getCurrent();
+    if(nthreads==0) {
+        for(size_t i=0; i<nrecords; ++i) master->addRecord(pvRecords[i]);
+    } else {
+        master->addRecords(pvRecords,nthreads);
+    }
+    double add = epicsTime::getCurrent() - start;
+    start = epicsTime::getCurrent();
+    if(nthreads==0) {
+        for(size_t i=0; i<nrecords; ++i) master->removeRecord(pvRecords[i]);
+    } else {
+        master->removeRecords(pvRecords);
+    }
+    double remove = epicsTime::getCurrent() - start;
+    if(nthreads==0) {
+        cout << "addRecord          ";
+    } else {
+        cout << "addRecords nthreads " << nthreads;
+    }
+    cout << " nrecords " << nrecords
+         << " add " << add*1e3 << " milliseconds"
+         << " remove " << remove*1e3 << " milliseconds"
+         << endl;
+}
+
+int main(int argc,char *argv[])
+{
+    size_t nrecords = 100000;
+    size_t nthreads = 4;
+    if(argc>1) nrecords = atoi(argv[1]);
+    if(argc>2) nthreads = atoi(argv[2]);
+    measure(nrecords,0);
+    measure(nrecords,1);
+    measure(nrecords,nthreads);
+    return 0;
+}
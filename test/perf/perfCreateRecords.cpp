@@ -0,0 +1,95 @@
+/* perfCreateRecords.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures the startup time of creating structured records with
+ * PVDatabase::createRecords and adding them with PVDatabase::addRecords
+ * as a function of the number of threads.
+ *
+ * usage: perfCreateRecords [nrecords] [nsub] [maxthreads]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <epicsTime.h>
+
+#include <pv/pvData.h>
+#include <pv/pvDatabase.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvDatabase;
+
+class StructureCreator :
+    public PVRecordCreator
+{
+public:
+    StructureCreator(size_t nsub,int pass)
+    : pass(pass)
+    {
+        FieldCreatePtr fieldCreate = getFieldCreate();
+        StructureConstPtr sub = fieldCreate->createFieldBuilder()->
+            add("value",pvDouble)->
+            add("low",pvDouble)->
+            add("high",pvDouble)->
+            add("units",pvString)->
+            addArray("history",pvDouble)->
+            createStructure();
+        FieldBuilderPtr fb = fieldCreate->createFieldBuilder();
+        for(size_t i=0; i<nsub; ++i) {
+            std::stringstream ss;
+            ss << "s" << i;
+            fb->add(ss.str(),sub);
+        }
+        structure = fb->createStructure();
+    }
+    virtual PVRecordPtr create(size_t index)
+    {
+        std::stringstream ss;
+        ss << "perfCreate" << pass << ":" << index;
+        return PVRecord::create(
+            ss.str(),getPVDataCreate()->createPVStructure(structure));
+    }
+private:
+    StructureConstPtr structure;
+    int pass;
+};
+
+static void measure(size_t nrecords,size_t nsub,size_t nthreads,int pass)
+{
+    PVDatabasePtr master = PVDatabase::getMaster();
+    StructureCreator creator(nsub,pass);
+    epicsTime start = epicsTime::getCurrent();
+    PVRecordPtrArray pvRecords =
+        PVDatabase::createRecords(creator,nrecords,nthreads);
+    double create = epicsTime::getCurrent() - start;
+    start = epicsTime::getCurrent();
+    master->addRecords(pvRecords,nthreads);
+    double add = epicsTime::getCurrent() - start;
+    cout << "nthreads " << nthreads
+         << " nrecords " << nrecords
+         << " nfields " << pvRecords[0]->getPVStructure()->getNumberFields()
+         << " create " << create*1e3 << " milliseconds"
+         << " add " << add*1e3 << " milliseconds"
+         << endl;
+    master->removeRecords(pvRecords);
+}
+
+int main(int argc,char *argv[])
+{
+    size_t nrecords = 10000;
+    size_t nsub = 20;
+    size_t maxthreads = 8;
+    if(argc>1) nrecords = atoi(argv[1]);
+    if(argc>2) nsub = atoi(argv[2]);
+    if(argc>3) maxthreads = atoi(argv[3]);
+    int pass = 0;
+    for(size_t n=1; n<=maxthreads; n*=2) measure(nrecords,nsub,n,pass++);
+    return 0;
+}
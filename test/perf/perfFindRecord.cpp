@@ -0,0 +1,119 @@
+/* perfFindRecord.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures PVDatabase::findRecord throughput with several threads
+ * looking up records, as ChannelProviderLocal does for each
+ * channelFind and createChannel.
+ * Half of the lookups are for names that do not exist.
+ *
+ * usage: perfFindRecord [nthreads] [nrecords] [seconds]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+
+#include <pv/pvData.h>
+#include <pv/pvDatabase.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvDatabase;
+
+static string recordName(size_t index)
+{
+    std::stringstream ss;
+    ss << "perfFind:" << index;
+    return ss.str();
+}
+
+class Finder :
+    public epicsThreadRunable
+{
+public:
+    Finder(PVDatabasePtr const & master,size_t nrecords,size_t seed)
+    : master(master),
+      stop(0),
+      nfind(0),
+      nfound(0),
+      thread(*this,"finder",
+          epicsThreadGetStackSize(epicsThreadStackSmall),
+          epicsThreadPriorityLow)
+    {
+        for(size_t i=0; i<1024; ++i) {
+            size_t index = (seed + i*7919) % (2*nrecords);
+            names.push_back(recordName(index));
+        }
+    }
+    void start() { thread.start(); }
+    void halt() { epicsAtomicSetIntT(&stop,1); done.wait(); }
+    virtual void run()
+    {
+        size_t i = 0;
+        while(!epicsAtomicGetIntT(&stop)) {
+            if(master->findRecord(names[i++ & 1023])) ++nfound;
+            ++nfind;
+        }
+        done.signal();
+    }
+    PVDatabasePtr master;
+    vector<string> names;
+    int stop;
+    size_t nfind;
+    size_t nfound;
+    epicsEvent done;
+    epicsThread thread;
+};
+
+int main(int argc,char *argv[])
+{
+    int nthreads = 8;
+    size_t nrecords = 100000;
+    double seconds = 2.0;
+    if(argc>1) nthreads = atoi(argv[1]);
+    if(argc>2) nrecords = atoi(argv[2]);
+    if(argc>3) seconds = atof(argv[3]);
+    PVDatabasePtr master = PVDatabase::getMaster();
+    StructureConstPtr structure = getFieldCreate()->createFieldBuilder()->
+        add("value",pvDouble)->createStructure();
+    for(size_t i=0; i<nrecords; ++i) {
+        PVRecordPtr pvRecord = PVRecord::create(
+            recordName(i),getPVDataCreate()->createPVStructure(structure));
+        master->addRecord(pvRecord);
+    }
+    for(int n=1; n<=nthreads; n*=2) {
+        vector<Finder *> finders;
+        for(int i=0; i<n; ++i) {
+            finders.push_back(new Finder(master,nrecords,i*104729));
+        }
+        epicsTime start = epicsTime::getCurrent();
+        for(int i=0; i<n; ++i) finders[i]->start();
+        epicsThreadSleep(seconds);
+        size_t nfind = 0;
+        size_t nfound = 0;
+        for(int i=0; i<n; ++i) {
+            finders[i]->halt();
+            nfind += finders[i]->nfind;
+            nfound += finders[i]->nfound;
+            delete finders[i];
+        }
+        double diff = epicsTime::getCurrent() - start;
+        cout << "nthreads " << n
+             << " nrecords " << nrecords
+             << " lookups " << (nfind/diff)/1e6 << " million/second"
+             << " found " << nfound << "/" << nfind
+             << endl;
+    }
+    return 0;
+}
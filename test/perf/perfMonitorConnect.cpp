@@ -0,0 +1,103 @@
+/* perfMonitorConnect.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures the time to create and start a monitor with a large queueSize
+ * on a record with an array field, and to stop and destroy it.
+ * The request has a filter, so each monitor has its own queue.
+ *
+ * usage: perfMonitorConnect [nloop] [queueSize] [arrayLength]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <epicsTime.h>
+#include <epicsGuard.h>
+
+#include <pv/pvData.h>
+#include <pv/pvAccess.h>
+#include <pv/createRequest.h>
+#include <pv/pvDatabase.h>
+#include <pv/channelProviderLocal.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvAccess;
+using namespace epics::pvDatabase;
+
+class Requester :
+    public MonitorRequester
+{
+public:
+    POINTER_DEFINITIONS(Requester);
+    virtual ~Requester() {}
+    virtual string getRequesterName() { return "perfMonitorConnect"; }
+    virtual void message(string const & message,MessageType messageType)
+    {
+        cout << message << endl;
+    }
+    virtual void monitorConnect(
+        Status const & status,
+        MonitorPtr const & monitor,
+        StructureConstPtr const & structure) {}
+    virtual void monitorEvent(MonitorPtr const & monitor)
+    {
+        MonitorElementPtr element;
+        while((element = monitor->poll())) monitor->release(element);
+    }
+    virtual void unlisten(MonitorPtr const & monitor) {}
+};
+
+static void measure(int nloop,size_t queueSize,size_t arrayLength)
+{
+    PVStructurePtr pvStructure = getPVDataCreate()->createPVStructure(
+        getFieldCreate()->createFieldBuilder()->
+            add("count",pvInt)->
+            addArray("value",pvDouble)->
+            createStructure());
+    PVDoubleArray::svector value(arrayLength);
+    pvStructure->getSubField<PVDoubleArray>("value")->replace(freeze(value));
+    PVRecordPtr pvRecord = PVRecord::create("perfConnect",pvStructure);
+    Requester::shared_pointer requester(new Requester());
+    std::stringstream ss;
+    ss << "record[queueSize=" << queueSize << "]field(count[deadband=abs:1.0],value)";
+    PVStructurePtr pvRequest = CreateRequest::create()->createRequest(ss.str());
+    double connect = 0.0;
+    double disconnect = 0.0;
+    for(int n=0; n<nloop; ++n) {
+        epicsTime start = epicsTime::getCurrent();
+        MonitorPtr monitor = createMonitorLocal(pvRecord,requester,pvRequest);
+        monitor->start();
+        epicsTime started = epicsTime::getCurrent();
+        monitor->stop();
+        monitor->destroy();
+        monitor.reset();
+        epicsTime end = epicsTime::getCurrent();
+        connect += started - start;
+        disconnect += end - started;
+    }
+    cout << "queueSize " << queueSize
+         << " arrayLength " << arrayLength
+         << " create and start " << (connect/nloop)*1e6 << " microseconds"
+         << " stop and destroy " << (disconnect/nloop)*1e6 << " microseconds"
+         << endl;
+}
+
+int main(int argc,char *argv[])
+{
+    int nloop = 100;
+    size_t queueSize = 100;
+    size_t arrayLength = 1000;
+    if(argc>1) nloop = atoi(argv[1]);
+    if(argc>2) queueSize = atoi(argv[2]);
+    if(argc>3) arrayLength = atoi(argv[3]);
+    measure(nloop,2,arrayLength);
+    measure(nloop,queueSize,arrayLength);
+    return 0;
+}
@@ -0,0 +1,116 @@
+/* perfMonitorDispatch.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures the put latency of a writer to a record with monitors
+ * whose monitorEvent takes some time.
+ * The monitors either use the default dispatch,
+ * where monitorEvent is called by the writer,
+ * or record._options.dispatch=async.
+ *
+ * usage: perfMonitorDispatch [nputs] [nmonitors] [eventMicroseconds]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsGuard.h>
+
+#include <pv/pvData.h>
+#include <pv/pvAccess.h>
+#include <pv/createRequest.h>
+#include <pv/pvDatabase.h>
+#include <pv/channelProviderLocal.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvAccess;
+using namespace epics::pvDatabase;
+
+class SlowRequester :
+    public MonitorRequester
+{
+public:
+    POINTER_DEFINITIONS(SlowRequester);
+    explicit SlowRequester(double eventTime) : eventTime(eventTime) {}
+    virtual ~SlowRequester() {}
+    virtual string getRequesterName() { return "perfMonitorDispatch"; }
+    virtual void message(string const & message,MessageType messageType)
+    {
+        cout << message << endl;
+    }
+    virtual void monitorConnect(
+        Status const & status,
+        MonitorPtr const & monitor,
+        StructureConstPtr const & structure) {}
+    virtual void monitorEvent(MonitorPtr const & monitor)
+    {
+        // a busy wait, like a consumer that serializes the data
+        epicsTime start = epicsTime::getCurrent();
+        while(epicsTime::getCurrent() - start < eventTime) {}
+        MonitorElementPtr element;
+        while((element = monitor->poll())) monitor->release(element);
+    }
+    virtual void unlisten(MonitorPtr const & monitor) {}
+    double eventTime;
+};
+
+static void measure(int nputs,size_t nmonitors,double eventTime,bool async)
+{
+    PVStructurePtr pvStructure = getPVDataCreate()->createPVStructure(
+        getFieldCreate()->createFieldBuilder()->
+            add("value",pvDouble)->
+            createStructure());
+    PVRecordPtr pvRecord = PVRecord::create("perfDispatch",pvStructure);
+    PVDoublePtr pvValue = pvStructure->getSubField<PVDouble>("value");
+    SlowRequester::shared_pointer requester(new SlowRequester(eventTime));
+    vector<MonitorPtr> monitors;
+    for(size_t i=0; i<nmonitors; ++i) {
+        std::stringstream ss;
+        ss << "record[dispatch=" << (async ? "async" : "sync") << "]field(value)";
+        MonitorPtr monitor = createMonitorLocal(pvRecord,requester,
+            CreateRequest::create()->createRequest(ss.str()));
+        monitor->start();
+        monitors.push_back(monitor);
+    }
+    double total = 0.0;
+    double maximum = 0.0;
+    for(int n=0; n<nputs; ++n) {
+        epicsTime start = epicsTime::getCurrent();
+        {
+            epicsGuard<PVRecord> guard(*pvRecord);
+            pvValue->put(n);
+        }
+        double diff = epicsTime::getCurrent() - start;
+        total += diff;
+        if(diff>maximum) maximum = diff;
+        epicsThreadSleep(0.0);
+    }
+    for(size_t i=0; i<nmonitors; ++i) monitors[i]->stop();
+    cout << (async ? "async" : "sync ")
+         << " nmonitors " << nmonitors
+         << " put average " << (total/nputs)*1e6 << " microseconds"
+         << " maximum " << maximum*1e6 << " microseconds"
+         << endl;
+}
+
+int main(int argc,char *argv[])
+{
+    int nputs = 1000;
+    size_t nmonitors = 10;
+    double eventTime = 20e-6;
+    if(argc>1) nputs = atoi(argv[1]);
+    if(argc>2) nmonitors = atoi(argv[2]);
+    if(argc>3) eventTime = atof(argv[3])*1e-6;
+    measure(nputs,nmonitors,eventTime,false);
+    measure(nputs,nmonitors,eventTime,true);
+    return 0;
+}
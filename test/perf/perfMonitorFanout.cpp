@@ -0,0 +1,142 @@
+/* perfMonitorFanout.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures the time of a group put to a record with many monitors
+ * created by createMonitorLocal.
+ * The monitors either all have the same request, so they share one copy
+ * of each update, or each has a different request.
+ * Each monitor polls and releases its elements in monitorEvent.
+ *
+ * A different request leaves out one field, so nfields limits the
+ * number of different requests.
+ *
+ * usage: perfMonitorFanout [nputs] [nfields]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <vector>
+
+#include <epicsTime.h>
+#include <epicsGuard.h>
+
+#include <pv/pvData.h>
+#include <pv/pvAccess.h>
+#include <pv/createRequest.h>
+#include <pv/pvDatabase.h>
+#include <pv/channelProviderLocal.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvAccess;
+using namespace epics::pvDatabase;
+
+class Requester :
+    public MonitorRequester
+{
+public:
+    POINTER_DEFINITIONS(Requester);
+    Requester() : npoll(0) {}
+    virtual ~Requester() {}
+    virtual string getRequesterName() { return "perfMonitorFanout"; }
+    virtual void message(string const & message,MessageType messageType)
+    {
+        cout << message << endl;
+    }
+    virtual void monitorConnect(
+        Status const & status,
+        MonitorPtr const & monitor,
+        StructureConstPtr const & structure) {}
+    virtual void monitorEvent(MonitorPtr const & monitor)
+    {
+        MonitorElementPtr element;
+        while((element = monitor->poll())) {
+            ++npoll;
+            monitor->release(element);
+        }
+    }
+    virtual void unlisten(MonitorPtr const & monitor) {}
+    size_t npoll;
+};
+
+static PVRecordPtr createRecord(size_t nfields)
+{
+    FieldBuilderPtr fb = getFieldCreate()->createFieldBuilder();
+    for(size_t i=0; i<nfields; ++i) {
+        std::stringstream ss;
+        ss << "f" << i;
+        fb->add(ss.str(),pvDouble);
+    }
+    PVStructurePtr pvStructure =
+        getPVDataCreate()->createPVStructure(fb->createStructure());
+    return PVRecord::create("perfFanout",pvStructure);
+}
+
+// All fields, or all fields except one, which makes the request different.
+static string createRequestString(size_t nfields,size_t except)
+{
+    std::stringstream ss;
+    ss << "field(";
+    bool first = true;
+    for(size_t i=0; i<nfields; ++i) {
+        if(i==except) continue;
+        if(!first) ss << ",";
+        first = false;
+        ss << "f" << i;
+    }
+    ss << ")";
+    return ss.str();
+}
+
+static void measure(size_t nmonitors,int nputs,size_t nfields,bool shared)
+{
+    PVRecordPtr pvRecord = createRecord(nfields);
+    PVFieldPtrArray const & pvFields = pvRecord->getPVStructure()->getPVFields();
+    Requester::shared_pointer requester(new Requester());
+    vector<MonitorPtr> monitors;
+    for(size_t i=0; i<nmonitors; ++i) {
+        size_t except = shared ? nfields : i % nfields;
+        MonitorPtr monitor = createMonitorLocal(pvRecord,requester,
+            CreateRequest::create()->createRequest(createRequestString(nfields,except)));
+        monitor->start();
+        monitors.push_back(monitor);
+    }
+    epicsTime start = epicsTime::getCurrent();
+    for(int n=0; n<nputs; ++n) {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvRecord->beginGroupPut();
+        for(size_t i=0; i<pvFields.size(); ++i) {
+            static_cast<PVDouble*>(pvFields[i].get())->put(n);
+        }
+        pvRecord->endGroupPut();
+    }
+    double diff = epicsTime::getCurrent() - start;
+    for(size_t i=0; i<nmonitors; ++i) monitors[i]->stop();
+    cout << (shared ? "shared   " : "distinct ")
+         << " nmonitors " << nmonitors
+         << " nfields " << nfields
+         << " put " << (diff/nputs)*1e6 << " microseconds"
+         << " per monitor " << (diff/nputs/nmonitors)*1e9 << " nanoseconds"
+         << " polls " << requester->npoll
+         << endl;
+}
+
+int main(int argc,char *argv[])
+{
+    int nputs = 1000;
+    size_t nfields = 100;
+    if(argc>1) nputs = atoi(argv[1]);
+    if(argc>2) nfields = atoi(argv[2]);
+    size_t nmonitors[] = {1,10,100};
+    for(size_t i=0; i<sizeof(nmonitors)/sizeof(nmonitors[0]); ++i) {
+        measure(nmonitors[i],nputs,nfields,false);
+        measure(nmonitors[i],nputs,nfields,true);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+/* perfMonitorQueue.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures put to poll throughput of a monitor created by createMonitorLocal.
+ * A producer thread puts to a record and a consumer thread polls and
+ * releases the monitor elements.
+ *
+ * usage: perfMonitorQueue [nputs] [queueSize]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsGuard.h>
+#include <epicsAtomic.h>
+
+#include <pv/pvData.h>
+#include <pv/pvAccess.h>
+#include <pv/createRequest.h>
+#include <pv/pvDatabase.h>
+#include <pv/channelProviderLocal.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvAccess;
+using namespace epics::pvDatabase;
+
+class Consumer :
+    public MonitorRequester,
+    public epicsThreadRunable
+{
+public:
+    POINTER_DEFINITIONS(Consumer);
+    Consumer()
+    : stop(0),
+      npoll(0),
+      thread(*this,"consumer",
+          epicsThreadGetStackSize(epicsThreadStackSmall),
+          epicsThreadPriorityMedium)
+    {}
+    virtual ~Consumer() {}
+    virtual string getRequesterName() { return "perfMonitorQueue"; }
+    virtual void message(string const & message,MessageType messageType)
+    {
+        cout << message << endl;
+    }
+    virtual void monitorConnect(
+        Status const & status,
+        MonitorPtr const & monitor,
+        StructureConstPtr const & structure) {}
+    virtual void monitorEvent(MonitorPtr const & monitor) { event.signal(); }
+    virtual void unlisten(MonitorPtr const & monitor) {}
+    void start(MonitorPtr const & monitor)
+    {
+        this->monitor = monitor;
+        thread.start();
+    }
+    void halt() { epicsAtomicSetIntT(&stop,1); event.signal(); done.wait(); }
+    virtual void run()
+    {
+        while(!epicsAtomicGetIntT(&stop)) {
+            MonitorElementPtr element = monitor->poll();
+            if(!element) {
+                event.wait();
+                continue;
+            }
+            ++npoll;
+            monitor->release(element);
+        }
+        done.signal();
+    }
+    MonitorPtr monitor;
+    int stop;
+    size_t npoll;
+    epicsEvent event;
+    epicsEvent done;
+    epicsThread thread;
+};
+
+int main(int argc,char *argv[])
+{
+    int nputs = 1000000;
+    string queueSize("4");
+    if(argc>1) nputs = atoi(argv[1]);
+    if(argc>2) queueSize = argv[2];
+    PVRecordPtr pvRecord = PVRecord::create(
+        "perfMonitorQueue",
+        getPVDataCreate()->createPVStructure(
+            getFieldCreate()->createFieldBuilder()->
+                add("value",pvDouble)->createStructure()));
+    Consumer::shared_pointer consumer(new Consumer());
+    MonitorPtr monitor = createMonitorLocal(
+        pvRecord,
+        consumer,
+        CreateRequest::create()->createRequest(
+            "record[queueSize=" + queueSize + "]field(value)"));
+    monitor->start();
+    consumer->start(monitor);
+    PVDoublePtr pvValue = pvRecord->getPVStructure()->getSubField<PVDouble>("value");
+    epicsTime start = epicsTime::getCurrent();
+    for(int i=0; i<nputs; ++i) {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvValue->put(i);
+    }
+    double diff = epicsTime::getCurrent() - start;
+    epicsThreadSleep(0.1);
+    consumer->halt();
+    monitor->stop();
+    cout << "queueSize " << queueSize
+         << " puts " << (nputs/diff)/1e6 << " million/second"
+         << " polled " << consumer->npoll << "/" << nputs
+         << endl;
+    return 0;
+}
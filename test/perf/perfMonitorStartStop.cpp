@@ -0,0 +1,104 @@
+/* perfMonitorStartStop.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures the cost of PVRecord::addListener/removeListener,
+ * which is what MonitorLocal::start/stop does, as a function of
+ * the number of fields in the record.
+ *
+ * usage: perfMonitorStartStop [nloop]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <epicsTime.h>
+
+#include <pv/pvData.h>
+#include <pv/createRequest.h>
+#include <pv/pvStructureCopy.h>
+#include <pv/pvDatabase.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvDatabase;
+using namespace epics::pvCopy;
+
+class PerfListener :
+    public PVListener
+{
+public:
+    POINTER_DEFINITIONS(PerfListener);
+    virtual ~PerfListener() {}
+    virtual void detach(PVRecordPtr const & pvRecord) {}
+    virtual void dataPut(PVRecordFieldPtr const & pvRecordField) {}
+    virtual void dataPut(
+        PVRecordStructurePtr const & requested,
+        PVRecordFieldPtr const & pvRecordField) {}
+    virtual void beginGroupPut(PVRecordPtr const & pvRecord) {}
+    virtual void endGroupPut(PVRecordPtr const & pvRecord) {}
+    virtual void unlisten(PVRecordPtr const & pvRecord) {}
+};
+
+static PVRecordPtr createRecord(size_t nfields)
+{
+    FieldBuilderPtr fb = getFieldCreate()->createFieldBuilder();
+    for(size_t i=0; i<nfields; ++i) {
+        std::stringstream ss;
+        ss << "f" << i;
+        fb->add(ss.str(),pvDouble);
+    }
+    PVStructurePtr pvStructure =
+        getPVDataCreate()->createPVStructure(fb->createStructure());
+    std::stringstream ss;
+    ss << "perf" << nfields;
+    return PVRecord::create(ss.str(),pvStructure);
+}
+
+static string createRequestString(size_t nfields)
+{
+    std::stringstream ss;
+    ss << "field(";
+    for(size_t i=0; i<nfields; ++i) {
+        if(i>0) ss << ",";
+        ss << "f" << i;
+    }
+    ss << ")";
+    return ss.str();
+}
+
+static void measure(size_t nfields,int nloop)
+{
+    PVRecordPtr pvRecord = createRecord(nfields);
+    PVStructurePtr pvRequest =
+        CreateRequest::create()->createRequest(createRequestString(nfields));
+    PVCopyPtr pvCopy = PVCopy::create(pvRecord->getPVStructure(),pvRequest,"");
+    PVListenerPtr listener(new PerfListener());
+    epicsTime start = epicsTime::getCurrent();
+    for(int i=0; i<nloop; ++i) {
+        pvRecord->addListener(listener,pvCopy);
+        pvRecord->removeListener(listener,pvCopy);
+    }
+    epicsTime end = epicsTime::getCurrent();
+    double diff = end - start;
+    cout << "nfields " << nfields
+         << " start/stop " << (diff/nloop)*1e6 << " microseconds"
+         << " per field " << (diff/nloop/nfields)*1e9 << " nanoseconds"
+         << endl;
+}
+
+int main(int argc,char *argv[])
+{
+    int nloop = 100;
+    if(argc>1) nloop = atoi(argv[1]);
+    size_t nfields[] = {10,100,1000,5000};
+    for(size_t i=0; i<sizeof(nfields)/sizeof(nfields[0]); ++i) {
+        measure(nfields[i],nloop);
+    }
+    return 0;
+}
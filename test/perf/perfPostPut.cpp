@@ -0,0 +1,112 @@
+/* perfPostPut.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures the cost of a put to a field of a record,
+ * which calls PVRecordField::postPut,
+ * for a record without listeners, for a record with a change set listener,
+ * which is what a monitor adds, and for a record with a field listener.
+ *
+ * usage: perfPostPut [nloop]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <epicsTime.h>
+#include <epicsGuard.h>
+
+#include <pv/pvData.h>
+#include <pv/createRequest.h>
+#include <pv/pvStructureCopy.h>
+#include <pv/pvDatabase.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvDatabase;
+using namespace epics::pvCopy;
+
+class PerfListener :
+    public PVListener
+{
+public:
+    POINTER_DEFINITIONS(PerfListener);
+    virtual ~PerfListener() {}
+    virtual void detach(PVRecordPtr const & pvRecord) {}
+    virtual void dataPut(PVRecordFieldPtr const & pvRecordField) {}
+    virtual void dataPut(
+        PVRecordStructurePtr const & requested,
+        PVRecordFieldPtr const & pvRecordField) {}
+    virtual void beginGroupPut(PVRecordPtr const & pvRecord) {}
+    virtual void endGroupPut(PVRecordPtr const & pvRecord) {}
+    virtual void unlisten(PVRecordPtr const & pvRecord) {}
+    virtual void dataPutChangeSet(
+        PVRecordPtr const & pvRecord,
+        BitSetPtr const & changedBitSet) {}
+};
+
+enum ListenerKind {noListener,changeSetListener,fieldListener};
+
+// nsub substructures of 10 doubles
+static PVRecordPtr createRecord(size_t nsub)
+{
+    FieldCreatePtr fieldCreate = getFieldCreate();
+    FieldBuilderPtr sub = fieldCreate->createFieldBuilder();
+    for(size_t i=0; i<10; ++i) {
+        std::stringstream ss;
+        ss << "f" << i;
+        sub->add(ss.str(),pvDouble);
+    }
+    StructureConstPtr subStructure = sub->createStructure();
+    FieldBuilderPtr fb = fieldCreate->createFieldBuilder();
+    for(size_t i=0; i<nsub; ++i) {
+        std::stringstream ss;
+        ss << "s" << i;
+        fb->add(ss.str(),subStructure);
+    }
+    PVStructurePtr pvStructure =
+        getPVDataCreate()->createPVStructure(fb->createStructure());
+    return PVRecord::create("perfPostPut",pvStructure);
+}
+
+static void measure(size_t nsub,int nloop,ListenerKind kind)
+{
+    PVRecordPtr pvRecord = createRecord(nsub);
+    PVListenerPtr listener(new PerfListener());
+    PVCopyPtr pvCopy = PVCopy::create(
+        pvRecord->getPVStructure(),
+        CreateRequest::create()->createRequest("field(s0.f0)"),
+        "");
+    if(kind==changeSetListener) pvRecord->addChangeSetListener(listener);
+    if(kind==fieldListener) pvRecord->addListener(listener,pvCopy);
+    PVDoublePtr pvValue = pvRecord->getPVStructure()->getSubField<PVDouble>("s0.f0");
+    epicsGuard<PVRecord> guard(*pvRecord);
+    epicsTime start = epicsTime::getCurrent();
+    for(int i=0; i<nloop; ++i) pvValue->put(i);
+    double diff = epicsTime::getCurrent() - start;
+    const char * names[] = {"no listener ","change set  ","field       "};
+    cout << names[kind]
+         << " nfields " << pvRecord->getPVStructure()->getNumberFields()
+         << " put " << (diff/nloop)*1e9 << " nanoseconds"
+         << endl;
+    if(kind==changeSetListener) pvRecord->removeChangeSetListener(listener);
+    if(kind==fieldListener) pvRecord->removeListener(listener,pvCopy);
+}
+
+int main(int argc,char *argv[])
+{
+    int nloop = 1000000;
+    if(argc>1) nloop = atoi(argv[1]);
+    size_t nsub[] = {1,10,100};
+    for(size_t i=0; i<sizeof(nsub)/sizeof(nsub[0]); ++i) {
+        measure(nsub[i],nloop,noListener);
+        measure(nsub[i],nloop,changeSetListener);
+        measure(nsub[i],nloop,fieldListener);
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+/* perfRecordMemory.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Reports the size of the per field metadata of a record
+ * and the time to create records like NTScalar.
+ *
+ * usage: perfRecordMemory [nrecords]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <epicsTime.h>
+
+#include <pv/pvData.h>
+#include <pv/standardPVField.h>
+#include <pv/pvDatabase.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvDatabase;
+
+int main(int argc,char *argv[])
+{
+    int nrecords = 200000;
+    if(argc>1) nrecords = atoi(argv[1]);
+    cout << "sizeof(PVRecordField) " << sizeof(PVRecordField) << endl;
+    cout << "sizeof(PVRecordStructure) " << sizeof(PVRecordStructure) << endl;
+    StandardPVFieldPtr standardPVField = getStandardPVField();
+    PVRecordPtrArray pvRecords;
+    pvRecords.reserve(nrecords);
+    size_t nfields = 0;
+    size_t nstructures = 0;
+    epicsTime start = epicsTime::getCurrent();
+    for(int i=0; i<nrecords; ++i) {
+        std::stringstream ss;
+        ss << "perfRecordMemory" << i;
+        PVStructurePtr pvStructure = standardPVField->scalar(
+            pvDouble,"alarm,timeStamp,display,control");
+        PVRecordPtr pvRecord = PVRecord::create(ss.str(),pvStructure);
+        pvRecords.push_back(pvRecord);
+    }
+    double diff = epicsTime::getCurrent() - start;
+    PVRecordPtr pvRecord = pvRecords[0];
+    size_t n = pvRecord->getPVStructure()->getNumberFields();
+    for(size_t offset=0; offset<n; ++offset) {
+        PVRecordFieldPtr pvRecordField = pvRecord->findPVRecordField(offset);
+        if(pvRecordField->getPVField()->getField()->getType()==structure) {
+            ++nstructures;
+        } else {
+            ++nfields;
+        }
+    }
+    size_t perRecord = nfields*sizeof(PVRecordField)
+        + nstructures*sizeof(PVRecordStructure);
+    cout << "nrecords " << nrecords
+         << " create " << (diff/nrecords)*1e6 << " microseconds per record" << endl;
+    cout << "per record " << nfields << " fields "
+         << nstructures << " structures "
+         << perRecord << " bytes of PVRecordField objects"
+         << " (not counting shared_ptr control blocks and heap strings)" << endl;
+    cout << "total " << (perRecord*nrecords)/(1024*1024) << " MiB" << endl;
+    return 0;
+}
@@ -0,0 +1,124 @@
+/* perfRemoveRecord.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures the latency of PVDatabase::removeRecord and the worst
+ * latency of PVDatabase::findRecord in another thread while a record
+ * with many clients is removed.
+ *
+ * usage: perfRemoveRecord [nloop]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+
+#include <pv/pvData.h>
+#include <pv/pvDatabase.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvDatabase;
+
+class PerfListener :
+    public PVListener
+{
+public:
+    POINTER_DEFINITIONS(PerfListener);
+    virtual ~PerfListener() {}
+    virtual void detach(PVRecordPtr const & pvRecord) {}
+    virtual void dataPut(PVRecordFieldPtr const & pvRecordField) {}
+    virtual void dataPut(
+        PVRecordStructurePtr const & requested,
+        PVRecordFieldPtr const & pvRecordField) {}
+    virtual void beginGroupPut(PVRecordPtr const & pvRecord) {}
+    virtual void endGroupPut(PVRecordPtr const & pvRecord) {}
+    // stands in for the work a monitor or channel does when detached
+    virtual void unlisten(PVRecordPtr const & pvRecord) { epicsThreadSleep(0.00001); }
+};
+
+class Finder :
+    public epicsThreadRunable
+{
+public:
+    Finder(PVDatabasePtr const & master)
+    : master(master),
+      stop(0),
+      maximum(0.0),
+      thread(*this,"finder",
+          epicsThreadGetStackSize(epicsThreadStackSmall),
+          epicsThreadPriorityMedium)
+    {}
+    void start() { thread.start(); }
+    void halt() { epicsAtomicSetIntT(&stop,1); done.wait(); }
+    virtual void run()
+    {
+        while(!epicsAtomicGetIntT(&stop)) {
+            epicsTime start = epicsTime::getCurrent();
+            master->findRecord("perfRemoveOther");
+            double diff = epicsTime::getCurrent() - start;
+            if(diff>maximum) maximum = diff;
+        }
+        done.signal();
+    }
+    PVDatabasePtr master;
+    int stop;
+    double maximum;
+    epicsEvent done;
+    epicsThread thread;
+};
+
+static void measure(size_t nclients,int nloop)
+{
+    PVDatabasePtr master = PVDatabase::getMaster();
+    StructureConstPtr structure = getFieldCreate()->createFieldBuilder()->
+        add("value",pvDouble)->createStructure();
+    vector<PVListenerPtr> listeners;
+    for(size_t i=0; i<nclients; ++i) listeners.push_back(PVListenerPtr(new PerfListener()));
+    double remove = 0.0;
+    double reaped = 0.0;
+    Finder finder(master);
+    finder.start();
+    for(int n=0; n<nloop; ++n) {
+        PVRecordPtr pvRecord = PVRecord::create(
+            "perfRemove",getPVDataCreate()->createPVStructure(structure));
+        master->addRecord(pvRecord);
+        for(size_t i=0; i<nclients; ++i) pvRecord->addChangeSetListener(listeners[i]);
+        epicsTime start = epicsTime::getCurrent();
+        master->removeRecord(pvRecord);
+        remove += epicsTime::getCurrent() - start;
+        master->waitForRemovedRecords();
+        reaped += epicsTime::getCurrent() - start;
+    }
+    finder.halt();
+    cout << "nclients " << nclients
+         << " removeRecord " << (remove/nloop)*1e6 << " microseconds"
+         << " clients detached " << (reaped/nloop)*1e3 << " milliseconds"
+         << " findRecord maximum " << finder.maximum*1e6 << " microseconds"
+         << endl;
+}
+
+int main(int argc,char *argv[])
+{
+    int nloop = 10;
+    if(argc>1) nloop = atoi(argv[1]);
+    PVDatabasePtr master = PVDatabase::getMaster();
+    master->addRecord(PVRecord::create("perfRemoveOther",
+        getPVDataCreate()->createPVStructure(
+            getFieldCreate()->createFieldBuilder()->
+                add("value",pvDouble)->createStructure())));
+    size_t nclients[] = {0,100,1000,10000};
+    for(size_t i=0; i<sizeof(nclients)/sizeof(nclients[0]); ++i) {
+        measure(nclients[i],nloop);
+    }
+    return 0;
+}
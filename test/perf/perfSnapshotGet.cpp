@@ -0,0 +1,155 @@
+/* perfSnapshotGet.cpp */
+/**
+ * Copyright - See the COPYRIGHT that is included with this distribution.
+ * EPICS pvData is distributed subject to a Software License Agreement found
+ * in file LICENSE that is included with this distribution.
+ */
+/**
+ * Measures the latency of a writer doing group puts to a record
+ * while reader threads do what ChannelGetLocal::get does.
+ * The readers either take the shared lock and copy from the record
+ * or copy from the latest snapshot without taking the record lock.
+ *
+ * usage: perfSnapshotGet [nreaders] [nputs] [nfields]
+ */
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsGuard.h>
+#include <epicsAtomic.h>
+
+#include <pv/pvData.h>
+#include <pv/createRequest.h>
+#include <pv/pvStructureCopy.h>
+#include <pv/pvDatabase.h>
+
+using namespace std;
+using namespace epics::pvData;
+using namespace epics::pvDatabase;
+using namespace epics::pvCopy;
+
+static PVRecordPtr createRecord(size_t nfields,bool snapshot)
+{
+    FieldBuilderPtr fb = getFieldCreate()->createFieldBuilder();
+    for(size_t i=0; i<nfields; ++i) {
+        std::stringstream ss;
+        ss << "f" << i;
+        fb->add(ss.str(),pvDouble);
+    }
+    PVStructurePtr pvStructure =
+        getPVDataCreate()->createPVStructure(fb->createStructure());
+    PVRecordPtr pvRecord = PVRecord::create("perfSnapshot",pvStructure);
+    epicsGuard<PVRecord> guard(*pvRecord);
+    pvRecord->setSnapshotEnabled(snapshot);
+    return pvRecord;
+}
+
+class Reader :
+    public epicsThreadRunable
+{
+public:
+    Reader(PVRecordPtr const & pvRecord,bool snapshot)
+    : pvRecord(pvRecord),
+      snapshot(snapshot),
+      stop(0),
+      ngets(0),
+      thread(*this,"reader",
+          epicsThreadGetStackSize(epicsThreadStackSmall),
+          epicsThreadPriorityLow)
+    {
+        pvCopy = PVCopy::create(
+            pvRecord->getPVStructure(),
+            CreateRequest::create()->createRequest(""),
+            "");
+        pvCopyStructure = pvCopy->createPVStructure();
+        bitSet = BitSetPtr(new BitSet(pvCopyStructure->getNumberFields()));
+    }
+    void start() { thread.start(); }
+    void halt() { epicsAtomicSetIntT(&stop,1); done.wait(); }
+    virtual void run()
+    {
+        while(!epicsAtomicGetIntT(&stop)) {
+            bitSet->clear();
+            if(snapshot) {
+                PVRecordSnapshotPtr pvSnapshot = pvRecord->getSnapshot();
+                pvCopy->updateCopySetBitSet(
+                    pvCopyStructure,bitSet,pvSnapshot->getPVStructure());
+            } else {
+                PVRecordSharedGuard guard(*pvRecord);
+                pvCopy->updateCopySetBitSet(pvCopyStructure,bitSet);
+            }
+            ++ngets;
+        }
+        done.signal();
+    }
+    PVRecordPtr pvRecord;
+    bool snapshot;
+    int stop;
+    size_t ngets;
+    PVCopyPtr pvCopy;
+    PVStructurePtr pvCopyStructure;
+    BitSetPtr bitSet;
+    epicsEvent done;
+    epicsThread thread;
+};
+
+static void measure(int nreaders,int nputs,size_t nfields,bool snapshot)
+{
+    PVRecordPtr pvRecord = createRecord(nfields,snapshot);
+    PVFieldPtrArray const & pvFields = pvRecord->getPVStructure()->getPVFields();
+    Reader **readers = new Reader*[nreaders];
+    for(int i=0; i<nreaders; ++i) {
+        readers[i] = new Reader(pvRecord,snapshot);
+        readers[i]->start();
+    }
+    double total = 0.0;
+    double maximum = 0.0;
+    for(int n=0; n<nputs; ++n) {
+        epicsTime start = epicsTime::getCurrent();
+        {
+            epicsGuard<PVRecord> guard(*pvRecord);
+            pvRecord->beginGroupPut();
+            for(size_t i=0; i<pvFields.size(); ++i) {
+                static_cast<PVDouble*>(pvFields[i].get())->put(n);
+            }
+            pvRecord->endGroupPut();
+        }
+        double diff = epicsTime::getCurrent() - start;
+        total += diff;
+        if(diff>maximum) maximum = diff;
+        epicsThreadSleep(0.0);
+    }
+    size_t ngets = 0;
+    for(int i=0; i<nreaders; ++i) {
+        readers[i]->halt();
+        ngets += readers[i]->ngets;
+        delete readers[i];
+    }
+    delete[] readers;
+    cout << (snapshot ? "snapshot   " : "sharedLock ")
+         << " nreaders " << nreaders
+         << " nfields " << nfields
+         << " put average " << (total/nputs)*1e6 << " microseconds"
+         << " maximum " << maximum*1e6 << " microseconds"
+         << " gets " << ngets
+         << endl;
+}
+
+int main(int argc,char *argv[])
+{
+    int nreaders = 8;
+    int nputs = 10000;
+    size_t nfields = 200;
+    if(argc>1) nreaders = atoi(argv[1]);
+    if(argc>2) nputs = atoi(argv[2]);
+    if(argc>3) nfields = atoi(argv[3]);
+    measure(nreaders,nputs,nfields,false);
+    measure(nreaders,nputs,nfields,true);
+    return 0;
+}
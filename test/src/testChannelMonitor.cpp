@@ -15,11 +15,14 @@
 #include <cstdio>
 #include <memory>
 #include <iostream>
+#include <vector>
+#include <algorithm>
 
 #include <epicsStdio.h>
 #include <epicsMutex.h>
 #include <epicsEvent.h>
 #include <epicsThread.h>
+#include <epicsGuard.h>
 
 #include <pv/standardField.h>
 #include <pv/standardPVField.h>
@@ -29,6 +32,7 @@
 #include <pv/serverContext.h>
 #include <pv/event.h>
 #include <pv/clientFactory.h>
+#include <pv/createRequest.h>
 
 using namespace std;
 using std::tr1::static_pointer_cast;
@@ -304,9 +308,312 @@ static void test()
 
 }
 
+class LocalMonitorRequester : public MonitorRequester
+{
+public:
+    POINTER_DEFINITIONS(LocalMonitorRequester);
+    virtual string getRequesterName() { return "LocalMonitorRequester"; }
+    virtual void message(const std::string& message, MessageType messageType)
+    {
+        if(debug) cout << "[" << getRequesterName() << "] " << message << endl;
+    }
+    virtual void monitorConnect(const Status& status, const Monitor::shared_pointer& monitor, const Structure::const_shared_pointer& structure) {}
+    virtual void monitorEvent(const Monitor::shared_pointer& monitor) {}
+    virtual void unlisten(const Monitor::shared_pointer& monitor) {}
+};
+
+// Fills a queue of 4 elements: the initial element, x=1, y=2,
+// and a put of id=5 that finds the queue full.
+static Monitor::shared_pointer createOverflowMonitor(
+    PVRecordPtr const & pvRecord,
+    string const & overflow)
+{
+    PVStructurePtr pvStructure = pvRecord->getPVStructure();
+    MonitorRequester::shared_pointer requester(new LocalMonitorRequester());
+    Monitor::shared_pointer monitor = createMonitorLocal(
+        pvRecord,
+        requester,
+        CreateRequest::create()->createRequest(
+            "record[queueSize=4,overflow=" + overflow + "]field(id,x,y)"));
+    if(!monitor) return monitor;
+    monitor->start();
+    epicsGuard<PVRecord> guard(*pvRecord);
+    pvStructure->getSubField<PVInt>("x")->put(1);
+    pvStructure->getSubField<PVInt>("y")->put(2);
+    pvStructure->getSubField<PVInt>("id")->put(5);
+    return monitor;
+}
+
+// The update held back by a full queue is queued by the dispatch pool
+// after a release, so it may take a moment to arrive.
+static MonitorElement::shared_pointer waitPoll(Monitor::shared_pointer const & monitor)
+{
+    for(int i=0; i<500; ++i) {
+        MonitorElement::shared_pointer element = monitor->poll();
+        if(element) return element;
+        epicsThreadSleep(0.01);
+    }
+    return MonitorElement::shared_pointer();
+}
+
+static void overflowTest()
+{
+    PVRecordPtr pvRecord = PVRecord::create("overflow",createTestPvStructure());
+    Monitor::shared_pointer monitor = createOverflowMonitor(pvRecord,"coalesce");
+    int npoll = 0;
+    MonitorElement::shared_pointer element;
+    while((element = monitor->poll())) {
+        ++npoll;
+        monitor->release(element);
+    }
+    testOk1(npoll==3);
+    monitor->stop();
+
+    monitor = createOverflowMonitor(pvRecord,"latest");
+    element = monitor->poll();
+    testOk1(element && element->pvStructurePtr->getSubField<PVInt>("x")->get()==1
+        && element->pvStructurePtr->getSubField<PVInt>("y")->get()==2);
+    testOk1(element && element->changedBitSet->get(0));
+    MonitorElement * merged = element.get();
+    if(element) monitor->release(element);
+    // the newest update does not wait for another put
+    element = waitPoll(monitor);
+    testOk1(element && element->pvStructurePtr->getSubField<PVInt>("id")->get()==5
+        && element->changedBitSet->get(1));
+    if(element) monitor->release(element);
+    testOk1(!monitor->poll());
+    {
+        PVStructurePtr pvStructure = pvRecord->getPVStructure();
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvStructure->getSubField<PVInt>("x")->put(3);
+        pvStructure->getSubField<PVInt>("y")->put(4);
+    }
+    // poll merges into the same element each time
+    element = monitor->poll();
+    testOk1(element && element.get()==merged
+        && element->pvStructurePtr->getSubField<PVInt>("y")->get()==4);
+    if(element) monitor->release(element);
+    monitor->stop();
+
+    monitor = createOverflowMonitor(pvRecord,"dropOldest");
+    element = monitor->poll();
+    testOk1(element && element->pvStructurePtr->getSubField<PVInt>("x")->get()==1);
+    if(element) monitor->release(element);
+    element = monitor->poll();
+    testOk1(element && element->changedBitSet->get(3) && !element->changedBitSet->get(2));
+    if(element) monitor->release(element);
+    element = waitPoll(monitor);
+    testOk1(element && element->pvStructurePtr->getSubField<PVInt>("id")->get()==5);
+    if(element) monitor->release(element);
+    testOk1(!monitor->poll());
+    monitor->stop();
+
+    testOk1(!createOverflowMonitor(pvRecord,"newest"));
+}
+
+static void sharedTest()
+{
+    PVRecordPtr pvRecord = PVRecord::create("shared",createTestPvStructure());
+    PVStructurePtr pvStructure = pvRecord->getPVStructure();
+    MonitorRequester::shared_pointer requester(new LocalMonitorRequester());
+    Monitor::shared_pointer first = createMonitorLocal(pvRecord,requester,
+        CreateRequest::create()->createRequest("field(id,x)"));
+    Monitor::shared_pointer second = createMonitorLocal(pvRecord,requester,
+        CreateRequest::create()->createRequest("record[queueSize=5]field(id,x)"));
+    Monitor::shared_pointer other = createMonitorLocal(pvRecord,requester,
+        CreateRequest::create()->createRequest("field(x,id)"));
+    first->start();
+    second->start();
+    other->start();
+    PVRecordStats stats = pvRecord->getStats();
+    testOk1(stats.numberListeners==2 && stats.numberMonitors==3);
+    MonitorElement::shared_pointer element;
+    Monitor::shared_pointer monitors[] = {first,second,other};
+    for(size_t i=0; i<3; ++i) {
+        // the initial elements
+        if((element = monitors[i]->poll())) monitors[i]->release(element);
+    }
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvStructure->getSubField<PVInt>("x")->put(7);
+    }
+    MonitorElement::shared_pointer firstElement = first->poll();
+    MonitorElement::shared_pointer secondElement = second->poll();
+    MonitorElement::shared_pointer otherElement = other->poll();
+    testOk1(firstElement && secondElement
+        && firstElement->pvStructurePtr==secondElement->pvStructurePtr);
+    testOk1(otherElement && firstElement
+        && otherElement->pvStructurePtr!=firstElement->pvStructurePtr);
+    testOk1(secondElement && secondElement->pvStructurePtr->getSubField<PVInt>("x")->get()==7
+        && secondElement->changedBitSet->get(2) && !secondElement->changedBitSet->get(1));
+    if(firstElement) first->release(firstElement);
+    if(secondElement) second->release(secondElement);
+    if(otherElement) other->release(otherElement);
+    first->stop();
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvStructure->getSubField<PVInt>("x")->put(8);
+    }
+    testOk1(!first->poll());
+    secondElement = second->poll();
+    testOk1(secondElement && secondElement->pvStructurePtr->getSubField<PVInt>("x")->get()==8);
+    if(secondElement) second->release(secondElement);
+    second->stop();
+    other->stop();
+}
+
+class AsyncMonitorRequester : public LocalMonitorRequester
+{
+public:
+    POINTER_DEFINITIONS(AsyncMonitorRequester);
+    AsyncMonitorRequester() : eventThread(0) {}
+    virtual void monitorEvent(const Monitor::shared_pointer& monitor)
+    {
+        eventThread = epicsThreadGetIdSelf();
+        event.signal();
+    }
+    epicsThreadId eventThread;
+    epicsEvent event;
+};
+
+static void asyncTest()
+{
+    PVRecordPtr pvRecord = PVRecord::create("async",createTestPvStructure());
+    PVStructurePtr pvStructure = pvRecord->getPVStructure();
+    AsyncMonitorRequester::shared_pointer requester(new AsyncMonitorRequester());
+    Monitor::shared_pointer monitor = createMonitorLocal(pvRecord,requester,
+        CreateRequest::create()->createRequest("record[dispatch=async]field(id,x)"));
+    monitor->start();
+    testOk1(requester->event.wait(5.0));
+    MonitorElement::shared_pointer element = monitor->poll();
+    if(element) monitor->release(element);
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvStructure->getSubField<PVInt>("x")->put(9);
+    }
+    testOk1(requester->event.wait(5.0));
+    testOk1(requester->eventThread!=epicsThreadGetIdSelf());
+    element = monitor->poll();
+    testOk1(element && element->pvStructurePtr->getSubField<PVInt>("x")->get()==9);
+    if(element) monitor->release(element);
+    monitor->stop();
+}
+
+static void throttleTest()
+{
+    PVRecordPtr pvRecord = PVRecord::create("throttle",createTestPvStructure());
+    PVStructurePtr pvStructure = pvRecord->getPVStructure();
+    MonitorRequester::shared_pointer requester(new LocalMonitorRequester());
+    Monitor::shared_pointer monitor = createMonitorLocal(pvRecord,requester,
+        CreateRequest::create()->createRequest("record[maxRate=5]field(id,x)"));
+    monitor->start();
+    MonitorElement::shared_pointer element = monitor->poll();
+    if(element) monitor->release(element);
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvStructure->getSubField<PVInt>("x")->put(1);
+        pvStructure->getSubField<PVInt>("x")->put(2);
+    }
+    testOk1(!monitor->poll());
+    // the throttle timer queues the last value without another put
+    epicsThreadSleep(0.5);
+    element = monitor->poll();
+    testOk1(element && element->pvStructurePtr->getSubField<PVInt>("x")->get()==2);
+    testOk1(element && element->changedBitSet->get(2) && element->overrunBitSet->get(2));
+    if(element) monitor->release(element);
+    monitor->stop();
+
+    testOk1(!createMonitorLocal(pvRecord,requester,
+        CreateRequest::create()->createRequest("record[maxRate=0]field(id,x)")));
+}
+
+static void poolTest()
+{
+    PVRecordPtr pvRecord = PVRecord::create("pool",createTestPvStructure());
+    PVStructurePtr pvStructure = pvRecord->getPVStructure();
+    MonitorRequester::shared_pointer requester(new LocalMonitorRequester());
+    // a filter, so the monitor has its own queue
+    Monitor::shared_pointer monitor = createMonitorLocal(pvRecord,requester,
+        CreateRequest::create()->createRequest("field(id,x[deadband=abs:1.0])"));
+    monitor->start();
+    std::vector<PVStructure *> used;
+    MonitorElement::shared_pointer element = monitor->poll();
+    if(element) {
+        used.push_back(element->pvStructurePtr.get());
+        monitor->release(element);
+    }
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvStructure->getSubField<PVInt>("x")->put(5);
+    }
+    element = monitor->poll();
+    testOk1(element && element->pvStructurePtr->getSubField<PVInt>("x")->get()==5);
+    if(element) {
+        used.push_back(element->pvStructurePtr.get());
+        monitor->release(element);
+    }
+    element.reset();
+    monitor->stop();
+    // the elements given back by stop are taken again
+    monitor->start();
+    element = monitor->poll();
+    testOk1(element
+        && std::find(used.begin(),used.end(),element->pvStructurePtr.get())!=used.end());
+    if(element) monitor->release(element);
+    monitor->stop();
+}
+
+static void adaptiveTest()
+{
+    PVRecordPtr pvRecord = PVRecord::create("adaptive",createTestPvStructure());
+    PVIntPtr pvX = pvRecord->getPVStructure()->getSubField<PVInt>("x");
+    MonitorRequester::shared_pointer requester(new LocalMonitorRequester());
+    Monitor::shared_pointer monitor = createMonitorLocal(pvRecord,requester,
+        CreateRequest::create()->createRequest("record[queueSize=2,maxQueueSize=8]field(id,x)"));
+    monitor->start();
+    MonitorElement::shared_pointer element = monitor->poll();
+    if(element) monitor->release(element);
+    for(int i=1; i<=4; ++i) {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvX->put(i);
+    }
+    // the queue grew instead of merging the updates
+    MonitorLocalStats stats;
+    testOk1(getMonitorLocalStats(monitor,stats)
+        && stats.queueSize==4 && stats.numberUsed==4 && stats.numberOverflow==0);
+    int npoll = 0;
+    int x = 0;
+    while((element = monitor->poll())) {
+        ++npoll;
+        x = element->pvStructurePtr->getSubField<PVInt>("x")->get();
+        monitor->release(element);
+    }
+    testOk1(npoll==4 && x==4);
+    // a client that keeps up lets the queue shrink
+    for(int i=5; i<305; ++i) {
+        {
+            epicsGuard<PVRecord> guard(*pvRecord);
+            pvX->put(i);
+        }
+        if((element = monitor->poll())) monitor->release(element);
+    }
+    testOk1(getMonitorLocalStats(monitor,stats)
+        && stats.queueSize==2 && stats.minQueueSize==1 && stats.maxQueueSize==7);
+    monitor->stop();
+
+    testOk1(!createMonitorLocal(pvRecord,requester,
+        CreateRequest::create()->createRequest("record[maxQueueSize=0]field(id,x)")));
+}
+
 MAIN(testChannelMonitor)
 {
-    testPlan(16);
+    testPlan(47);
     test();
+    overflowTest();
+    sharedTest();
+    asyncTest();
+    throttleTest();
+    poolTest();
+    adaptiveTest();
     return 0;
 }
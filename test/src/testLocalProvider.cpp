@@ -25,6 +25,7 @@
 #include <epicsMutex.h>
 #include <epicsEvent.h>
 #include <epicsThread.h>
+#include <epicsGuard.h>
 
 #include <pv/standardField.h>
 #include <pv/standardPVField.h>
@@ -32,6 +33,7 @@
 #include <pv/pvAccess.h>
 #include <pv/channelProviderLocal.h>
 #include <pv/serverContext.h>
+#include <pv/createRequest.h>
 #include "recordClient.h"
 #include "listener.h"
 
@@ -73,9 +75,75 @@ static void test()
     if(debug) {cout << "processed exampleDouble "  << endl; }
 }
 
+class SnapshotRequester :
+    public ChannelRequester,
+    public ChannelGetRequester
+{
+public:
+    POINTER_DEFINITIONS(SnapshotRequester);
+    virtual string getRequesterName() { return "SnapshotRequester"; }
+    virtual void message(string const & message,MessageType messageType)
+    {
+        if(debug) cout << message << endl;
+    }
+    virtual void channelCreated(const Status& status,Channel::shared_pointer const & channel) {}
+    virtual void channelStateChange(
+        Channel::shared_pointer const & channel,
+        Channel::ConnectionState connectionState) {}
+    virtual void channelGetConnect(
+        const Status& status,
+        ChannelGet::shared_pointer const & channelGet,
+        Structure::const_shared_pointer const & structure) {}
+    virtual void getDone(
+        const Status& status,
+        ChannelGet::shared_pointer const & channelGet,
+        PVStructurePtr const & pvStructure,
+        BitSetPtr const & bitSet)
+    {
+        value = pvStructure ? pvStructure->getSubField<PVDouble>("value")->get() : -1.0;
+    }
+    double value;
+};
+
+// snapshots enabled the way the iocsh command pvdbSnapshot does
+static void snapshotGetTest()
+{
+    PVDatabasePtr master = PVDatabase::getMaster();
+    ChannelProviderLocalPtr channelProvider = getChannelProviderLocal();
+    PVRecordPtr pvRecord(PVRecord::create("snapshotDouble",
+        getStandardPVField()->scalar(pvDouble,"alarm,timeStamp")));
+    master->addRecord(pvRecord);
+    PVDoublePtr pvValue = pvRecord->getPVStructure()->getSubField<PVDouble>("value");
+    testOk1(master->setSnapshotEnabled("snapshot*",true)==1);
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvValue->put(5.0);
+    }
+    SnapshotRequester::shared_pointer requester(new SnapshotRequester());
+    Channel::shared_pointer channel =
+        channelProvider->createChannel("snapshotDouble",requester);
+    ChannelGet::shared_pointer channelGet = channel->createChannelGet(
+        requester,CreateRequest::create()->createRequest("value"));
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvValue->put(7.0);
+        // the put is not published yet, so the get sees the snapshot
+        channelGet->get();
+        testOk1(requester->value==5.0);
+    }
+    channelGet->get();
+    testOk1(requester->value==7.0);
+    testOk1(master->setSnapshotEnabled("snapshotDouble",false)==1);
+    testOk1(!pvRecord->getSnapshot());
+    channelGet->destroy();
+    channel->destroy();
+    master->removeRecord(pvRecord);
+}
+
 MAIN(testLocalProvider)
 {
-    testPlan(3);
+    testPlan(8);
     test();
+    snapshotGetTest();
     return 0;
 }
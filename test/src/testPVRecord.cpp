@@ -19,16 +19,23 @@
 #include <cstdio>
 #include <memory>
 #include <iostream>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
 
 #include <epicsStdio.h>
 #include <epicsMutex.h>
 #include <epicsEvent.h>
 #include <epicsThread.h>
+#include <epicsGuard.h>
 
 #include <pv/standardField.h>
 #include <pv/standardPVField.h>
 #include <pv/pvData.h>
 #include <pv/pvStructureCopy.h>
+#include <pv/createRequest.h>
+#include <pv/pvRecordTrace.h>
 #define epicsExportSharedSymbols
 #include "powerSupply.h"
 
@@ -42,6 +49,45 @@ using std::string;
 
 static bool debug = false;
 
+class CountListener :
+    public PVListener
+{
+public:
+    POINTER_DEFINITIONS(CountListener);
+    CountListener() : numberPut(0), numberUnlisten(0) {}
+    virtual ~CountListener() {}
+    virtual void detach(PVRecordPtr const & pvRecord) {}
+    virtual void dataPut(PVRecordFieldPtr const & pvRecordField) {++numberPut;}
+    virtual void dataPut(
+        PVRecordStructurePtr const & requested,
+        PVRecordFieldPtr const & pvRecordField) {++numberPut;}
+    virtual void beginGroupPut(PVRecordPtr const & pvRecord) {}
+    virtual void endGroupPut(PVRecordPtr const & pvRecord) {}
+    virtual void unlisten(PVRecordPtr const & pvRecord) {++numberUnlisten;}
+    int numberPut;
+    int numberUnlisten;
+};
+typedef std::tr1::shared_ptr<CountListener> CountListenerPtr;
+
+class ChangeSetListener :
+    public CountListener
+{
+public:
+    POINTER_DEFINITIONS(ChangeSetListener);
+    ChangeSetListener() : numberChangeSet(0), changed(new BitSet()) {}
+    virtual ~ChangeSetListener() {}
+    virtual void dataPutChangeSet(
+        PVRecordPtr const & pvRecord,
+        BitSetPtr const & changedBitSet)
+    {
+        ++numberChangeSet;
+        *changed = *changedBitSet;
+    }
+    int numberChangeSet;
+    BitSetPtr changed;
+};
+typedef std::tr1::shared_ptr<ChangeSetListener> ChangeSetListenerPtr;
+
 static PVRecordPtr createScalar(
     string const & recordName,
     ScalarType scalarType,
@@ -52,6 +98,25 @@ static PVRecordPtr createScalar(
     return pvRecord;
 }
 
+class FailStartRecord :
+    public PVRecord
+{
+public:
+    POINTER_DEFINITIONS(FailStartRecord);
+    static FailStartRecordPtr create(string const & recordName)
+    {
+        PVStructurePtr pvStructure = getStandardPVField()->scalar(pvDouble,"");
+        FailStartRecordPtr pvRecord(new FailStartRecord(recordName,pvStructure));
+        pvRecord->initPVRecord();
+        return pvRecord;
+    }
+    // not a runtime_error, addRecords must still throw one
+    virtual void start() { throw std::logic_error("start failed"); }
+private:
+    FailStartRecord(string const & recordName,PVStructurePtr const & pvStructure)
+    : PVRecord(recordName,pvStructure) {}
+};
+
 static PVRecordPtr createScalarArray(
     string const & recordName,
     ScalarType scalarType,
@@ -95,11 +160,464 @@ static void powerSupplyTest()
     }
 }
 
+static void findFieldTest()
+{
+    if(debug) {cout << endl << endl << "****findFieldTest****" << endl; }
+    PVStructurePtr pv = createPowerSupply();
+    PVRecordPtr pvRecord = PowerSupply::create("powerSupplyFind",pv);
+    PVStructurePtr pvStructure = pvRecord->getPVStructure();
+    size_t numberFields = pvStructure->getNumberFields();
+    bool ok = true;
+    for(size_t offset=0; offset<numberFields; ++offset) {
+        PVRecordFieldPtr pvRecordField = pvRecord->findPVRecordField(offset);
+        if(!pvRecordField
+        || pvRecordField->getPVField()->getFieldOffset()!=offset) ok = false;
+    }
+    testOk(ok,"findPVRecordField by offset");
+    PVFieldPtr pvField = pvStructure->getSubField("power.value");
+    PVRecordFieldPtr pvRecordField = pvRecord->findPVRecordField(pvField);
+    testOk1(pvRecordField->getPVField().get()==pvField.get());
+    testOk1(pvRecordField->getFullFieldName()=="power.value");
+}
+
+static void listenerTest()
+{
+    if(debug) {cout << endl << endl << "****listenerTest****" << endl; }
+    PVRecordPtr pvRecord = createScalar("doubleListener",pvDouble,"alarm,timeStamp");
+    PVStructurePtr pvRequest = CreateRequest::create()->createRequest("field(value)");
+    PVCopyPtr pvCopy = PVCopy::create(pvRecord->getPVStructure(),pvRequest,"");
+    CountListenerPtr listener1(new CountListener());
+    CountListenerPtr listener2(new CountListener());
+    testOk1(pvRecord->addListener(listener1,pvCopy));
+    testOk1(pvRecord->addListener(listener2,pvCopy));
+    PVDoublePtr pvValue = pvRecord->getPVStructure()->getSubField<PVDouble>("value");
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvRecord->beginGroupPut();
+        pvValue->put(1.0);
+        pvRecord->endGroupPut();
+    }
+    testOk1(listener1->numberPut>0 && listener1->numberPut==listener2->numberPut);
+    testOk1(pvRecord->removeListener(listener1,pvCopy));
+    testOk1(!pvRecord->removeListener(listener1,pvCopy));
+    int numberPut1 = listener1->numberPut;
+    int numberPut2 = listener2->numberPut;
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvValue->put(2.0);
+    }
+    testOk1(listener1->numberPut==numberPut1);
+    testOk1(listener2->numberPut>numberPut2);
+    testOk1(pvRecord->removeListener(listener2,pvCopy));
+    // no listener is left, posting skips the fields
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvValue->put(3.0);
+    }
+    testOk1(pvValue->get()==3.0);
+    testOk1(pvRecord->addListener(listener1,pvCopy));
+    numberPut1 = listener1->numberPut;
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvValue->put(4.0);
+    }
+    testOk1(listener1->numberPut>numberPut1);
+    testOk1(pvRecord->removeListener(listener1,pvCopy));
+}
+
+static void changeSetTest()
+{
+    if(debug) {cout << endl << endl << "****changeSetTest****" << endl; }
+    PVRecordPtr pvRecord = createScalar("doubleChangeSet",pvDouble,"alarm,timeStamp");
+    PVStructurePtr pvStructure = pvRecord->getPVStructure();
+    ChangeSetListenerPtr listener(new ChangeSetListener());
+    testOk1(pvRecord->addChangeSetListener(listener));
+    PVDoublePtr pvValue = pvStructure->getSubField<PVDouble>("value");
+    PVIntPtr pvSeverity = pvStructure->getSubField<PVInt>("alarm.severity");
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvRecord->beginGroupPut();
+        pvValue->put(1.0);
+        pvValue->put(2.0);
+        pvSeverity->put(1);
+        testOk1(listener->numberChangeSet==0);
+        pvRecord->endGroupPut();
+    }
+    testOk1(listener->numberChangeSet==1);
+    testOk1(listener->numberPut==0);
+    testOk1(listener->changed->get(pvValue->getFieldOffset()));
+    testOk1(listener->changed->get(pvSeverity->getFieldOffset()));
+    testOk1(listener->changed->cardinality()==2);
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvValue->put(3.0);
+    }
+    testOk1(listener->numberChangeSet==2);
+    testOk1(listener->changed->cardinality()==1);
+    testOk1(pvRecord->removeChangeSetListener(listener));
+    testOk1(!pvRecord->removeChangeSetListener(listener));
+}
+
+static void sharedLockTest()
+{
+    if(debug) {cout << endl << endl << "****sharedLockTest****" << endl; }
+    PVRecordPtr pvRecord = createScalar("doubleShared",pvDouble,"alarm,timeStamp");
+    pvRecord->lockShared();
+    {
+        PVRecordSharedGuard guard(*pvRecord);
+        testOk1(!pvRecord->tryLock());
+    }
+    testOk1(!pvRecord->tryLock());
+    pvRecord->unlockShared();
+    testOk1(pvRecord->tryLock());
+    {
+        PVRecordSharedGuard guard(*pvRecord);
+        testOk1(pvRecord->tryLock());
+        pvRecord->unlock();
+    }
+    pvRecord->unlock();
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        testPass("lock after shared locks released");
+    }
+}
+
+static void snapshotTest()
+{
+    if(debug) {cout << endl << endl << "****snapshotTest****" << endl; }
+    PVRecordPtr pvRecord = createScalar("doubleSnapshot",pvDouble,"alarm,timeStamp");
+    PVStructurePtr pvStructure = pvRecord->getPVStructure();
+    PVDoublePtr pvValue = pvStructure->getSubField<PVDouble>("value");
+    testOk1(!pvRecord->getSnapshot());
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvRecord->setSnapshotEnabled(true);
+    }
+    PVRecordSnapshotPtr first = pvRecord->getSnapshot();
+    testOk1(first && first->getVersion()==1);
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvRecord->beginGroupPut();
+        pvValue->put(5.0);
+        testOk1(pvRecord->getSnapshot()==first);
+        pvRecord->endGroupPut();
+    }
+    PVRecordSnapshotPtr second = pvRecord->getSnapshot();
+    testOk1(second->getVersion()==2);
+    testOk1(second->getPVStructure()->getSubField<PVDouble>("value")->get()==5.0);
+    testOk1(first->getPVStructure()->getSubField<PVDouble>("value")->get()==0.0);
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvValue->put(6.0);
+    }
+    PVRecordSnapshotPtr third = pvRecord->getSnapshot();
+    testOk1(third->getVersion()==3);
+    PVStructurePtr pvRequest = CreateRequest::create()->createRequest("value");
+    PVCopyPtr pvCopy = PVCopy::create(pvStructure,pvRequest,"");
+    PVStructurePtr pvCopyStructure = pvCopy->createPVStructure();
+    BitSetPtr bitSet(new BitSet(pvCopyStructure->getNumberFields()));
+    testOk1(!pvCopy->hasFilters());
+    testOk1(pvCopy->updateCopySetBitSet(pvCopyStructure,bitSet,second->getPVStructure()));
+    testOk1(pvCopyStructure->getSubField<PVDouble>("value")->get()==5.0);
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvRecord->setSnapshotEnabled(false);
+    }
+    testOk1(!pvRecord->getSnapshot());
+}
+
+static void lockSetTest()
+{
+    if(debug) {cout << endl << endl << "****lockSetTest****" << endl; }
+    PVRecordPtr first = createScalar("doubleLockSet1",pvDouble,"alarm,timeStamp");
+    PVRecordPtr second = createScalar("doubleLockSet2",pvDouble,"alarm,timeStamp");
+    PVRecordPtrArray pvRecords;
+    pvRecords.push_back(second);
+    pvRecords.push_back(PVRecordPtr());
+    pvRecords.push_back(first);
+    pvRecords.push_back(second);
+    PVRecordLockSet lockSet(pvRecords);
+    PVRecordPtrArray const & locked = lockSet.getPVRecords();
+    testOk1(locked.size()==2);
+    testOk1(locked[0].get()<locked[1].get());
+    ChangeSetListenerPtr firstListener(new ChangeSetListener());
+    ChangeSetListenerPtr secondListener(new ChangeSetListener());
+    first->addChangeSetListener(firstListener);
+    second->addChangeSetListener(secondListener);
+    {
+        epicsGuard<PVRecordLockSet> guard(lockSet);
+        lockSet.beginGroupPut();
+        first->getPVStructure()->getSubField<PVDouble>("value")->put(1.0);
+        second->getPVStructure()->getSubField<PVDouble>("value")->put(2.0);
+        testOk1(firstListener->numberChangeSet==0 && secondListener->numberChangeSet==0);
+        lockSet.endGroupPut();
+    }
+    testOk1(firstListener->numberChangeSet==1 && secondListener->numberChangeSet==1);
+}
+
+static void traceTest()
+{
+    if(debug) {cout << endl << endl << "****traceTest****" << endl; }
+    PVRecordPtr pvRecord = createScalar("doubleTrace",pvDouble,"alarm,timeStamp");
+    pvRecord->setTraceLevel(3);
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+    }
+    pvRecord->setTraceLevel(0);
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+    }
+    vector<PVRecordTraceEvent> events;
+    PVRecordTrace::getEvents(pvRecord.get(),events);
+    testOk1(events.size()==2);
+    testOk1(events.size()==2 && events[0].op==traceLock && events[1].op==traceUnlock);
+    testOk1(events.size()==2 && events[0].time<=events[1].time);
+}
+
+static void layoutTest()
+{
+    if(debug) {cout << endl << endl << "****layoutTest****" << endl; }
+    PVRecordPtr first = createScalar("doubleLayout1",pvDouble,"alarm,timeStamp");
+    PVRecordPtr second = createScalar("doubleLayout2",pvDouble,"alarm,timeStamp");
+    PVFieldPtr pvSeverity = second->getPVStructure()->getSubField("alarm.severity");
+    PVRecordFieldPtr pvRecordField = second->findPVRecordField(pvSeverity);
+    testOk1(pvRecordField->getFullFieldName()=="alarm.severity");
+    testOk1(pvRecordField->getFullName()=="doubleLayout2.alarm.severity");
+    testOk1(pvRecordField->getParent()->getPVField()
+        ==second->getPVStructure()->getSubField("alarm"));
+    testOk1(first->getPVRecordStructure()->getFullName()=="doubleLayout1");
+    testOk1(!first->getPVRecordStructure()->getParent());
+}
+
+static void statsTest()
+{
+    if(debug) {cout << endl << endl << "****statsTest****" << endl; }
+    PVRecordPtr pvRecord = createScalar("doubleStats",pvDouble,"alarm,timeStamp");
+    PVRecordStats stats = pvRecord->getStats();
+    testOk1(stats.numberProcess==0 && stats.numberGroupPut==0);
+    size_t numberLock = stats.numberLock;
+    {
+        epicsGuard<PVRecord> guard(*pvRecord);
+        pvRecord->beginGroupPut();
+        pvRecord->timedProcess();
+        pvRecord->timedProcess();
+        pvRecord->endGroupPut();
+    }
+    stats = pvRecord->getStats();
+    testOk1(stats.numberProcess==2);
+    testOk1(stats.numberGroupPut==1);
+    testOk1(stats.numberLock==numberLock+1);
+    size_t numberInHistogram = 0;
+    for(size_t i=0; i<PVRecordStats::numberProcessBins; ++i) {
+        numberInHistogram += stats.processHistogram[i];
+    }
+    testOk1(numberInHistogram==2);
+    CountListenerPtr listener(new CountListener());
+    pvRecord->addChangeSetListener(listener);
+    testOk1(pvRecord->getStats().numberListeners==1);
+}
+
+class ScalarCreator :
+    public PVRecordCreator
+{
+public:
+    virtual PVRecordPtr create(size_t index)
+    {
+        stringstream ss;
+        ss << "doubleCreated" << index;
+        return createScalar(ss.str(),pvDouble,"alarm,timeStamp");
+    }
+};
+
+static void createRecordsTest()
+{
+    if(debug) {cout << endl << endl << "****createRecordsTest****" << endl; }
+    PVDatabasePtr master = PVDatabase::getMaster();
+    ScalarCreator creator;
+    PVRecordPtrArray pvRecords = PVDatabase::createRecords(creator,20,4);
+    testOk1(pvRecords.size()==20);
+    testOk1(pvRecords[19] && pvRecords[19]->getRecordName()=="doubleCreated19");
+    testOk1(master->addRecords(pvRecords,4));
+    testOk1(master->removeRecords(pvRecords)==20);
+}
+
+static void addRecordsTest()
+{
+    if(debug) {cout << endl << endl << "****addRecordsTest****" << endl; }
+    PVDatabasePtr master = PVDatabase::getMaster();
+    PVRecordPtrArray pvRecords;
+    for(int i=0; i<10; ++i) {
+        stringstream ss;
+        ss << "doubleBulk" << i;
+        pvRecords.push_back(createScalar(ss.str(),pvDouble,"alarm,timeStamp"));
+    }
+    testOk1(master->addRecords(pvRecords,4));
+    testOk1(master->findRecord("doubleBulk0") && master->findRecord("doubleBulk9"));
+    PVRecordPtrArray duplicate;
+    duplicate.push_back(createScalar("doubleBulkNew",pvDouble,"alarm,timeStamp"));
+    duplicate.push_back(createScalar("doubleBulk5",pvDouble,"alarm,timeStamp"));
+    testOk1(!master->addRecords(duplicate));
+    testOk1(!master->findRecord("doubleBulkNew"));
+    testOk1(master->removeRecords(pvRecords)==10);
+    testOk1(!master->findRecord("doubleBulk0") && !master->findRecord("doubleBulk9"));
+    PVRecordPtrArray withNull(duplicate);
+    withNull[1] = PVRecordPtr();
+    testOk1(!master->addRecords(withNull) && !master->findRecord("doubleBulkNew"));
+    PVRecordPtrArray failStart(duplicate);
+    failStart[1] = FailStartRecord::create("doubleBulkFail");
+    bool thrown = false;
+    try {
+        master->addRecords(failStart,2);
+    } catch(std::runtime_error &) {
+        thrown = true;
+    }
+    testOk1(thrown && !master->findRecord("doubleBulkNew"));
+    thrown = false;
+    try {
+        master->addRecords(failStart);
+    } catch(std::runtime_error &) {
+        thrown = true;
+    }
+    testOk1(thrown && !master->findRecord("doubleBulkNew"));
+    // the name reserved by the failed call is free again
+    PVRecordPtrArray newOnly(1,createScalar("doubleBulkNew",pvDouble,"alarm,timeStamp"));
+    testOk1(master->addRecords(newOnly));
+    testOk1(master->removeRecords(newOnly)==1);
+}
+
+static void recordNameListTest()
+{
+    if(debug) {cout << endl << endl << "****recordNameListTest****" << endl; }
+    PVDatabasePtr master = PVDatabase::getMaster();
+    PVStringArray::const_svector first = master->getRecordNameList();
+    PVStringArray::const_svector second = master->getRecordNameList();
+    testOk1(first.dataPtr()==second.dataPtr());
+    size_t generation = master->getGeneration();
+    PVRecordPtr pvRecord = createScalar("doubleNameList",pvDouble,"alarm,timeStamp");
+    testOk1(master->addRecord(pvRecord));
+    testOk1(master->getGeneration()!=generation);
+    PVStringArray::const_svector third = master->getRecordNameList();
+    testOk1(third.size()==first.size()+1);
+    testOk1(std::binary_search(third.begin(),third.end(),string("doubleNameList")));
+    testOk1(master->removeRecord(pvRecord));
+}
+
+static void findRecordsTest()
+{
+    if(debug) {cout << endl << endl << "****findRecordsTest****" << endl; }
+    PVDatabasePtr master = PVDatabase::getMaster();
+    PVRecordPtrArray pvRecords;
+    pvRecords.push_back(createScalar("SR01:BPM1",pvDouble,"alarm,timeStamp"));
+    pvRecords.push_back(createScalar("SR01:BPM2",pvDouble,"alarm,timeStamp"));
+    pvRecords.push_back(createScalar("SR01:BPM10",pvDouble,"alarm,timeStamp"));
+    pvRecords.push_back(createScalar("SR01:COR1",pvDouble,"alarm,timeStamp"));
+    testOk1(master->addRecords(pvRecords));
+    PVStringArray::const_svector names = master->findRecords("SR01:BPM*");
+    testOk1(names.size()==3 && names[0]=="SR01:BPM1" && names[2]=="SR01:BPM2");
+    names = master->findRecords("SR01:BPM?");
+    testOk1(names.size()==2 && names[1]=="SR01:BPM2");
+    names = master->findRecords("SR01:*1");
+    testOk1(names.size()==2 && names[0]=="SR01:BPM1" && names[1]=="SR01:COR1");
+    testOk1(master->findRecords("SR01:BPM1").size()==1);
+    testOk1(master->findRecords("SR01:BPM").size()==0);
+    testOk1(master->removeRecords(pvRecords)==4);
+}
+
+static void databaseSnapshotTest()
+{
+    if(debug) {cout << endl << endl << "****databaseSnapshotTest****" << endl; }
+    PVDatabasePtr master = PVDatabase::getMaster();
+    PVRecordPtrArray pvRecords;
+    pvRecords.push_back(createScalar("doubleSave1",pvDouble,"alarm,timeStamp"));
+    pvRecords.push_back(createScalar("doubleSave2",pvDouble,"alarm,timeStamp"));
+    testOk1(master->addRecords(pvRecords));
+    PVDoublePtr first = pvRecords[0]->getPVStructure()->getSubField<PVDouble>("value");
+    PVDoublePtr second = pvRecords[1]->getPVStructure()->getSubField<PVDouble>("value");
+    {
+        epicsGuard<PVRecord> guard(*pvRecords[0]);
+        first->put(1.0);
+    }
+    {
+        epicsGuard<PVRecord> guard(*pvRecords[1]);
+        second->put(2.0);
+    }
+    string fileName("testPVRecordSnapshot.dat");
+    testOk1(master->saveSnapshot(fileName)==master->getRecordNameList().size());
+    {
+        epicsGuard<PVRecord> guard(*pvRecords[1]);
+        second->put(3.0);
+    }
+    string incrementalName("testPVRecordSnapshotIncremental.dat");
+    testOk1(master->saveSnapshot(incrementalName,true)==1);
+    {
+        PVRecordLockSet lockSet(pvRecords);
+        epicsGuard<PVRecordLockSet> guard(lockSet);
+        first->put(10.0);
+        second->put(20.0);
+    }
+    master->restoreSnapshot(fileName);
+    testOk1(first->get()==1.0 && second->get()==2.0);
+    testOk1(master->restoreSnapshot(incrementalName)==1);
+    testOk1(second->get()==3.0);
+    testOk1(master->removeRecords(pvRecords)==2);
+    // same name and number of fields but a different type is not restored
+    PVRecordPtr intRecord = createScalar("doubleSave1",pvInt,"alarm,timeStamp");
+    testOk1(master->addRecord(intRecord));
+    master->restoreSnapshot(fileName);
+    testOk1(intRecord->getPVStructure()->getSubField<PVInt>("value")->get()==0);
+    testOk1(master->removeRecord(intRecord));
+    // a length beyond the end of the file is rejected before it is allocated
+    {
+        ofstream out(fileName.c_str(),ios::out|ios::binary|ios::trunc);
+        const char header[] = "PVDBSNAP\0\0\0\2\0\0\0\0\0\0\0\1\xff\xff\xff\xf0";
+        out.write(header,sizeof(header)-1);
+    }
+    bool thrown = false;
+    try {
+        master->restoreSnapshot(fileName);
+    } catch(std::runtime_error &) {
+        thrown = true;
+    }
+    testOk1(thrown);
+    std::remove(fileName.c_str());
+    std::remove(incrementalName.c_str());
+}
+
+static void reaperTest()
+{
+    if(debug) {cout << endl << endl << "****reaperTest****" << endl; }
+    PVDatabasePtr master = PVDatabase::getMaster();
+    PVRecordPtr pvRecord = createScalar("doubleReaper",pvDouble,"alarm,timeStamp");
+    testOk1(master->addRecord(pvRecord));
+    CountListenerPtr listener(new CountListener());
+    pvRecord->addChangeSetListener(listener);
+    testOk1(master->removeRecord(pvRecord));
+    testOk1(!master->findRecord("doubleReaper"));
+    master->waitForRemovedRecords();
+    testOk1(listener->numberUnlisten==1);
+    testOk1(pvRecord->getStats().numberListeners==0);
+}
+
 MAIN(testPVRecord)
 {
-    testPlan(3);
+    testPlan(107);
     scalarTest();
     arrayTest();
     powerSupplyTest();
+    findFieldTest();
+    listenerTest();
+    changeSetTest();
+    sharedLockTest();
+    snapshotTest();
+    lockSetTest();
+    traceTest();
+    layoutTest();
+    statsTest();
+    addRecordsTest();
+    createRecordsTest();
+    recordNameListTest();
+    findRecordsTest();
+    databaseSnapshotTest();
+    reaperTest();
     return 0;
 }